@@ -51,7 +51,7 @@ void PrintHelp() {
 
     RESTcout.setheader("Usage1 : ./restManager ");
     RESTcout << "--c CONFIG_FILE [--i/f INPUT] [--o OUTPUT] [--j THREADS] [--e EVENTS_TO_PROCESS] [--v "
-                "VERBOSELEVEL] [--d RUNID] [--p PDF_PLOTS.pdf]"
+                "VERBOSELEVEL] [--d RUNID] [--p PDF_PLOTS.pdf] [--s SHARD]"
              << RESTendl;
     RESTcout.setheader("Usage2 : ./restManager ");
     RESTcout << "TASK_NAME ARG1 ARG2 ARG3" << RESTendl;
@@ -77,8 +77,13 @@ void PrintHelp() {
              << RESTendl;
     RESTcout.setheader("THREADS    : ");
     RESTcout << "-" << RESTendl;
-    RESTcout << "Enable specific number of threads to run the jobs. In most time 3~6 threads are "
-                "enough to make full use of computer power. Maximum is 15."
+    RESTcout << "Enable specific number of threads to run the jobs, or \"auto\" to use one thread per cpu "
+                "core and adapt the number of active threads at runtime."
+             << RESTendl;
+    RESTcout.setheader("SHARD      : ");
+    RESTcout << "-" << RESTendl;
+    RESTcout << "Process only the part i of N of the input entries, given as i/N (e.g. 0/4). The shard "
+                "outputs can be merged back with the restMergeShards macro."
              << RESTendl;
     RESTcout.setheader("");
     RESTcout << "=" << RESTendl;
@@ -201,6 +206,9 @@ int main(int argc, char* argv[]) {
                         case 'p':
                             REST_ARGS["pdfFilename"] = args[i + 1];
                             break;
+                        case 's':
+                            REST_ARGS["shard"] = args[i + 1];
+                            break;
                         default:
                             RESTcout << RESTendl;
                             PrintHelp();
@@ -115,6 +115,8 @@ void TRestEventRateAnalysisProcess::Initialize() {
     fEvent = NULL;
 
     fSingleThreadOnly = true;
+    // only the event time is used
+    fReadsEventData = false;
 
     fFirstEventTime = -1;
     fPreviousEventTime.clear();
@@ -130,7 +132,7 @@ void TRestEventRateAnalysisProcess::InitProcess() {
         fFirstEventTime = -1;
     }
     
-    // if is run under single thread mode, we add rate observables
+    // if is run under single thread mode, or in a serialized stage, we add rate observables
     fRateAnalysis = GetNumberOfParallelProcesses() <= 1;
 }
 
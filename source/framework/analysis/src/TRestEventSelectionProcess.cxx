@@ -92,6 +92,8 @@ TRestEventSelectionProcess::TRestEventSelectionProcess() { Initialize(); }
 ///
 void TRestEventSelectionProcess::Initialize() {
     SetSectionName(this->ClassName());
+    // only the event ID is used
+    fReadsEventData = false;
 
     fEvent = nullptr;
 }
@@ -27,6 +27,7 @@
 #include <TTree.h>
 
 #include <limits>
+#include <set>
 
 #include "TRestEvent.h"
 #include "TRestReflector.h"
@@ -50,6 +51,14 @@ class TRestAnalysisTree : public TTree {
     std::map<std::string, int> fObservableIdMap;        //!
     std::map<std::string, int> fObservableIdSearchMap;  //! used for quick search of certain observables
     TChain* fChain = nullptr;                           //! in case multiple files for reading
+    std::vector<TVirtualIndex*> fFileIndices;           //! event index of each file of the chain, if the
+                                                        //! event IDs are not sorted across the files
+
+    // skim of the observables saved, see SetObservableFilter()
+    std::vector<std::string> fKeepObservables;       //! patterns of the observables saved, all if empty
+    std::vector<std::string> fDropObservables;       //! patterns of the observables not saved
+    std::set<std::string> fRequiredObservables;      //! observables used in the process chain, e.g. by cuts
+    std::map<std::string, bool> fActiveObservables;  //! result of IsObservableActive() for each name
 
     // for storage
     Int_t fNObservables;
@@ -65,6 +74,8 @@ class TRestAnalysisTree : public TTree {
     void MakeObservableIdMap();
     void ReadLeafValueToObservable(TLeaf* lf, RESTValue& obs);
     bool BranchesExist() { return GetListOfBranches()->GetEntriesFast() > 0; }
+    Int_t BuildFileIndices();
+    void DeleteFileIndices();
 
     enum TRestAnalysisTree_Status {
         //!< Error state
@@ -296,6 +307,16 @@ class TRestAnalysisTree : public TTree {
 
     TTree* GetTree() const;
 
+    void SetObservableFilter(const std::vector<std::string>& keep, const std::vector<std::string>& drop);
+    Bool_t AddRequiredObservable(const std::string& obsName);
+    Bool_t IsObservableActive(const std::string& obsName);
+
+    Int_t BuildEventIndex();
+    Long64_t GetEntryWithEventID(Int_t eventID, Int_t subEventID = -1);
+    inline Bool_t HasEventIndex() const {
+        return GetTree()->GetTreeIndex() != nullptr || !fFileIndices.empty();
+    }
+
     TChain* GetChain() { return fChain; }
 
     Long64_t LoadTree(Long64_t entry);
@@ -0,0 +1,169 @@
+/*************************************************************************
+ * This file is part of the REST software framework.                     *
+ *                                                                       *
+ * Copyright (C) 2016 GIFNA/TREX (University of Zaragoza)                *
+ * For more information see http://gifna.unizar.es/trex                  *
+ *                                                                       *
+ * REST is free software: you can redistribute it and/or modify          *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * REST is distributed in the hope that it will be useful,               *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have a copy of the GNU General Public License along with   *
+ * REST in $REST_PATH/LICENSE.                                           *
+ * If not, see http://www.gnu.org/licenses/.                             *
+ * For the list of contributors see $REST_PATH/CREDITS.                  *
+ *************************************************************************/
+
+#ifndef RestCore_TRestBoundedQueue
+#define RestCore_TRestBoundedQueue
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+//////////////////////////////////////////////////////////////////////////
+/// \brief Bounded multi-producer multi-consumer queue used to connect the
+/// stages of TRestProcessRunner.
+///
+/// The fast path (TryPush()/TryPop()) is lock-free: each cell carries a
+/// sequence number which tells producers and consumers whether the cell is
+/// free or holds data. The blocking methods Push() and Pop() only fall back
+/// to a mutex and a condition variable when the queue is full or empty, so
+/// that waiting threads do not burn cores.
+///
+/// Close() wakes up all the waiting threads. After closing, Push() fails and
+/// Pop() returns the remaining items before failing.
+template <class T>
+class TRestBoundedQueue {
+   private:
+    struct Cell {
+        std::atomic<size_t> fSequence;
+        T fData;
+    };
+
+    std::unique_ptr<Cell[]> fBuffer;
+    size_t fMask;
+    alignas(64) std::atomic<size_t> fEnqueuePos;
+    alignas(64) std::atomic<size_t> fDequeuePos;
+
+    std::mutex fWaitMutex;
+    std::condition_variable fWaitCondition;
+    std::atomic<int> fWaiters;
+    std::atomic<bool> fClosed;
+
+    void NotifyWaiters() {
+        // The positions are updated with relaxed atomics. The fence orders that update before reading the
+        // waiter count, pairing with the waiter which increments the count before checking the positions.
+        // Without it both sides may miss each other and the wakeup is lost.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (fWaiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(fWaitMutex);
+            fWaitCondition.notify_all();
+        }
+    }
+
+   public:
+    /// Try to add an item without blocking. Returns false if the queue is full or closed.
+    bool TryPush(const T& item) {
+        if (fClosed.load()) return false;
+        size_t pos = fEnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = fBuffer[pos & fMask];
+            size_t seq = cell.fSequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (fEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.fData = item;
+                    cell.fSequence.store(pos + 1, std::memory_order_release);
+                    NotifyWaiters();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = fEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Try to take an item without blocking. Returns false if the queue is empty.
+    bool TryPop(T& item) {
+        size_t pos = fDequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = fBuffer[pos & fMask];
+            size_t seq = cell.fSequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (fDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = cell.fData;
+                    cell.fSequence.store(pos + fMask + 1, std::memory_order_release);
+                    NotifyWaiters();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = fDequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Add an item, waiting while the queue is full. Returns false if the queue is closed.
+    bool Push(const T& item) {
+        while (!TryPush(item)) {
+            std::unique_lock<std::mutex> lock(fWaitMutex);
+            fWaiters++;
+            fWaitCondition.wait(lock, [&] { return fClosed.load() || !Full(); });
+            fWaiters--;
+            if (fClosed.load()) return false;
+        }
+        return true;
+    }
+
+    /// Take an item, waiting while the queue is empty. Returns false once the queue is closed and drained.
+    bool Pop(T& item) {
+        while (!TryPop(item)) {
+            std::unique_lock<std::mutex> lock(fWaitMutex);
+            fWaiters++;
+            fWaitCondition.wait(lock, [&] { return fClosed.load() || !Empty(); });
+            fWaiters--;
+            if (fClosed.load() && Empty()) return false;
+        }
+        return true;
+    }
+
+    /// Reject further items and wake up all the waiting threads
+    void Close() {
+        std::lock_guard<std::mutex> lock(fWaitMutex);
+        fClosed = true;
+        fWaitCondition.notify_all();
+    }
+
+    inline bool IsClosed() const { return fClosed.load(); }
+    inline size_t Capacity() const { return fMask + 1; }
+    inline size_t Size() const { return fEnqueuePos.load() - fDequeuePos.load(); }
+    inline bool Empty() const { return Size() == 0; }
+    inline bool Full() const { return Size() >= Capacity(); }
+
+    /// The capacity is rounded up to the next power of two
+    explicit TRestBoundedQueue(size_t capacity) : fWaiters(0), fClosed(false) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        fMask = size - 1;
+        fBuffer.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            fBuffer[i].fSequence.store(i, std::memory_order_relaxed);
+        }
+        fEnqueuePos.store(0, std::memory_order_relaxed);
+        fDequeuePos.store(0, std::memory_order_relaxed);
+    }
+};
+
+#endif
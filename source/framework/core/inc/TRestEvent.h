@@ -47,6 +47,9 @@ class TRestEvent : public TObject {
     Bool_t fOk;  ///< Flag to be used by processes to define an event status. fOk=true is the default.
 
     TRestRun* fRun = nullptr;  //!
+    /// Entry of the input file whose data is not read yet, -1 if the event is complete.
+    /// See TRestRun::LoadEvent()
+    Long64_t fLazyEntry = -1;  //!
 #ifndef __CINT__
 
     TPad* fPad;  //!
@@ -54,6 +57,29 @@ class TRestEvent : public TObject {
 
     void RestartPad(Int_t nElements);
 
+    void CopyEventInfo(TRestEvent* target) const;
+    void SwapEventInfo(TRestEvent* target);
+
+    //////////////////////////////////////////////////////////////////////////
+    /// \brief Typed copy of this event into **target**, which is of the same type
+    ///
+    /// To be implemented in the derived class, returning true. It is used by CloneTo()
+    /// instead of the streamer. The default returns false.
+    virtual Bool_t FastCopyTo(TRestEvent* target) {
+        UNUSED(target);
+        return false;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    /// \brief Exchange the content of this event with **target**, which is of the same type
+    ///
+    /// To be implemented in the derived class, returning true. It is used by MoveTo()
+    /// to hand the data over without copying. The default returns false.
+    virtual Bool_t FastSwap(TRestEvent* target) {
+        UNUSED(target);
+        return false;
+    }
+
    public:
     // Setters
     inline void SetRunOrigin(Int_t run_origin) { fRunOrigin = run_origin; }
@@ -71,6 +97,7 @@ class TRestEvent : public TObject {
     inline void SetOK(Bool_t state) { fOk = state; }
 
     void SetEventInfo(TRestEvent* eve);
+    inline void SetLazyEntry(Long64_t entry) { fLazyEntry = entry; }
 
     // Getters
     inline Int_t GetID() const { return fEventID; }
@@ -84,6 +111,8 @@ class TRestEvent : public TObject {
     inline TTimeStamp GetTimeStamp() const { return fEventTime; }
 
     inline Bool_t isOk() const { return fOk; }
+    /// Returns the input entry whose data remains to be read, or -1, see TRestRun::LoadEvent()
+    inline Long64_t GetLazyEntry() const { return fLazyEntry; }
 
     virtual void Initialize() = 0;
     virtual void InitializeWithMetadata(TRestRun* run);
@@ -109,6 +138,7 @@ class TRestEvent : public TObject {
     }
 
     virtual void CloneTo(TRestEvent* target);
+    void MoveTo(TRestEvent* target);
 
     // Constructor
     TRestEvent();
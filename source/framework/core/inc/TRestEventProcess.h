@@ -26,7 +26,9 @@
 #include <TCanvas.h>
 #include <TNamed.h>
 
+#include <functional>
 #include <limits>
+#include <set>
 
 #include "TRestAnalysisTree.h"
 #include "TRestEvent.h"
@@ -34,6 +36,8 @@
 #include "TRestRun.h"
 
 /// A base class for any REST event process
+class TRestThreadPool;
+
 class TRestEventProcess : public TRestMetadata {
    protected:
     enum REST_Process_Output {
@@ -72,14 +76,20 @@ class TRestEventProcess : public TRestMetadata {
     TRestAnalysisTree* fAnalysisTree = nullptr;  //!
     ///< Pointer to TRestRun object where to find metadata.
     TRestRun* fRunInfo = nullptr;  //!
+    /// Worker pool of the process runner, used by ParallelFor(). nullptr outside of a run.
+    TRestThreadPool* fThreadPool = nullptr;  //!
     /// It defines if the process reads event data from an external source.
     bool fIsExternal = false;  //!
-    /// It defines if the process can run only under single std::thread mode. If true, the whole process
-    /// chain will not use multithreading. Useful for processes with viewing functionality. Always true for
-    /// external processes.
+    /// It defines if the process can run only under single std::thread mode. If true, a single instance
+    /// of the process handles the events of all the threads one by one, in the order they were read,
+    /// while the rest of the chain still runs in parallel. Useful for processes with viewing
+    /// functionality. Always true for external processes.
     bool fSingleThreadOnly = false;  //!
     /// not used, keep for compatibility
     bool fReadOnly = false;  //!
+    /// It defines if ProcessEvent() reads the data of the input event. If false, only its ID, time
+    /// and tag are used, and the data is not read from the input file with `lazyEventLoading`.
+    bool fReadsEventData = true;  //!
     /// It defines whether to use added observables only or all the observables appear in the code.
     bool fDynamicObs = false;  //!
     /// It defines if observable names should be added to the validation list
@@ -90,10 +100,15 @@ class TRestEventProcess : public TRestMetadata {
     std::map<std::string, int> fObservablesDefined;  //!     [name, id in AnalysisTree]
     /// Stores cut definitions. Any listed observables should be in the range.
     std::vector<std::pair<std::string, TVector2>> fCuts;  //!  [name, cut range]
+    /// The observables read by this process already registered in fAnalysisTree, see AddRequiredObservable()
+    std::set<std::string> fRequiredObservables;  //!
 
     // utils
     void BeginPrintProcess();
     void EndPrintProcess();
+    void AddRequiredObservable(const std::string& name);
+    void ParallelFor(Long64_t begin, Long64_t end, const std::function<void(Long64_t, Long64_t)>& body,
+                     Long64_t grain = 0);
     //////////////////////////////////////////////////////////////////////////
     /// \brief Get a metadata object from the host TRestRun
     ///
@@ -179,9 +194,31 @@ class TRestEventProcess : public TRestMetadata {
         }
     }
 
+    //////////////////////////////////////////////////////////////////////////
+    /// \brief Returns whether the observable **name** of this process is saved or
+    /// used in the process chain.
+    ///
+    /// The runner may save only some observables (`keepObservables` and
+    /// `dropObservables`). A process can then skip the computation of the other
+    /// ones:
+    ///
+    /// \code
+    /// if (IsObservableActive("energySpectrumMean")) {
+    ///     SetObservableValue("energySpectrumMean", ComputeSpectrumMean());
+    /// }
+    /// \endcode
+    ///
+    /// The value of a skipped observable is not valid. The observables read by
+    /// the other processes, through cuts or GetObservableValue(), are always active.
+    inline Bool_t IsObservableActive(const std::string& name) {
+        if (fAnalysisTree == nullptr) return true;
+        return fAnalysisTree->IsObservableActive(std::string(this->GetName()) + "_" + name);
+    }
+
     template <class T>
     T GetObservableValue(const std::string& name) {
         if (fAnalysisTree != nullptr) {
+            if (fRequiredObservables.count(name) == 0) AddRequiredObservable(name);
             return fAnalysisTree->GetObservableValue<T>(name);
         }
         return std::numeric_limits<T>::quiet_NaN();
@@ -200,6 +237,7 @@ class TRestEventProcess : public TRestMetadata {
 
     virtual const char* GetProcessName() const = 0;
     Int_t LoadSectionMetadata() override;
+    void CopySectionMetadata(const TRestMetadata* prototype) override;
     virtual void InitFromConfigFile() override {
         std::map<std::string, std::string> parameters = GetParametersList();
         for (auto& p : parameters) {
@@ -234,8 +272,12 @@ class TRestEventProcess : public TRestMetadata {
     // setters
     /// Set analysis tree of this process, then add observables to it
     void SetAnalysisTree(TRestAnalysisTree* tree);
+    /// Set analysis tree of this process, without adding the observables again
+    inline void SwitchAnalysisTree(TRestAnalysisTree* tree) { fAnalysisTree = tree; }
     /// Set TRestRun for this process
     inline void SetRunInfo(TRestRun* r) { fRunInfo = r; }
+    /// Set the worker pool used by ParallelFor()
+    inline void SetThreadPool(TRestThreadPool* pool) { fThreadPool = pool; }
     /// Set canvas size
     inline void SetCanvasSize(Int_t x, Int_t y) { fCanvasSize = TVector2(x, y); }
     /// Add friendly process to this process
@@ -259,6 +301,8 @@ class TRestEventProcess : public TRestMetadata {
     inline Bool_t singleThreadOnly() const { return fSingleThreadOnly; }
     /// Return whether this process is external process
     inline Bool_t isExternal() const { return fIsExternal; }
+    /// Return whether this process reads the data of the input event, see TRestRun::LoadEvent()
+    inline Bool_t readsEventData() const { return fReadsEventData; }
     /// Return the pointer of the hosting TRestRun object
     inline TRestRun* GetRunInfo() const { return fRunInfo; }
     /// Return the local analysis tree (dummy)
@@ -0,0 +1,52 @@
+/*************************************************************************
+ * This file is part of the REST software framework.                     *
+ *                                                                       *
+ * Copyright (C) 2016 GIFNA/TREX (University of Zaragoza)                *
+ * For more information see http://gifna.unizar.es/trex                  *
+ *                                                                       *
+ * REST is free software: you can redistribute it and/or modify          *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * REST is distributed in the hope that it will be useful,               *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have a copy of the GNU General Public License along with   *
+ * REST in $REST_PATH/LICENSE.                                           *
+ * If not, see http://www.gnu.org/licenses/.                             *
+ * For the list of contributors see $REST_PATH/CREDITS.                  *
+ *************************************************************************/
+
+#ifndef RestCore_TRestFileWatcher
+#define RestCore_TRestFileWatcher
+
+#include <Rtypes.h>
+
+#include <string>
+
+/// Wakes up a reader waiting for new data in its input files, with inotify where available.
+/// It is a transient helper of TRestRun, never streamed, so it has no ClassDef.
+class TRestFileWatcher {
+   private:
+    Int_t fNotifyFd;   //! inotify instance, -1 when polling
+    Int_t fWakeFd[2];  //! pipe used by Wake()
+    Int_t fNWatches;   //! paths being watched
+
+   public:
+    Bool_t Watch(const std::string& path);
+    Bool_t Wait(Double_t timeout);
+    void Wake();
+    void Close();
+
+    /// Returns true if the changes are notified, false if Wait() just sleeps
+    inline Bool_t IsNotifying() const { return fNotifyFd >= 0 && fNWatches > 0; }
+
+    // Constructor & Destructor
+    TRestFileWatcher();
+    ~TRestFileWatcher();
+};
+
+#endif
@@ -133,6 +133,8 @@ class TRestMetadata : public TNamed {
 
     // Load global setting for the rml section, e.g., name, title.
     virtual Int_t LoadSectionMetadata();
+    // Copy the global setting of an already loaded rml section
+    virtual void CopySectionMetadata(const TRestMetadata* prototype);
     /// To make settings from rml file. This method must be implemented in the derived class.
     virtual void InitFromConfigFile() {
         std::map<std::string, std::string> parameters = GetParametersList();
@@ -235,6 +237,7 @@ class TRestMetadata : public TNamed {
                                 std::map<std::string, std::string> envs = {});
     Int_t LoadConfigFromFile(const std::string& configFilename, const std::string& sectionName = "");
     Int_t LoadConfigFromBuffer();
+    Int_t LoadConfigFromMetadata(const TRestMetadata* prototype);
 
     TRestMetadata* InstantiateChildMetadata(int index, std::string pattern = "");
     TRestMetadata* InstantiateChildMetadata(std::string pattern = "", std::string name = "");
@@ -0,0 +1,93 @@
+/*************************************************************************
+ * This file is part of the REST software framework.                     *
+ *                                                                       *
+ * Copyright (C) 2016 GIFNA/TREX (University of Zaragoza)                *
+ * For more information see http://gifna.unizar.es/trex                  *
+ *                                                                       *
+ * REST is free software: you can redistribute it and/or modify          *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * REST is distributed in the hope that it will be useful,               *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have a copy of the GNU General Public License along with   *
+ * REST in $REST_PATH/LICENSE.                                           *
+ * If not, see http://www.gnu.org/licenses/.                             *
+ * For the list of contributors see $REST_PATH/CREDITS.                  *
+ *************************************************************************/
+
+#ifndef RestCore_TRestProcessProfile
+#define RestCore_TRestProcessProfile
+
+#include "TRestMetadata.h"
+
+class TRestEventProcess;
+
+//! Time spent and events rejected by each process of the chain, saved with the output file
+class TRestProcessProfile : public TRestMetadata {
+   private:
+    // one entry for each process of the chain
+    std::vector<std::string> fProcessNames;
+    std::vector<std::string> fProcessTypes;
+    std::vector<Long64_t> fEvents;                       // events entering the process
+    std::vector<Long64_t> fRejected;                     // events cut or dropped by the process
+    std::vector<Double_t> fWallTime;                     // in seconds
+    std::vector<Double_t> fCPUTime;                      // in seconds, cpu time of the running thread
+    std::vector<std::vector<Long64_t>> fWallHistograms;  // events per bin of log2(wall time in us)
+    std::vector<std::vector<Long64_t>> fCPUHistograms;   // events per bin of log2(cpu time in us)
+
+    // one entry for each thread
+    std::vector<Long64_t> fThreadEvents;    // events processed by the thread
+    std::vector<Double_t> fThreadLockWait;  // in seconds, waiting for the input and output locks
+
+    static Int_t TimeBin(Double_t seconds);
+    Double_t Quantile(const std::vector<Long64_t>& histogram, Double_t q) const;
+
+   public:
+    /// Number of bins of the time histograms. Bin 0 holds times below 1 us, and
+    /// bin i the times between 2^(i-1) and 2^i us.
+    static const Int_t kTimeBins = 32;
+
+    void Initialize() override;
+
+    void SetProcessChain(const std::vector<TRestEventProcess*>& chain);
+    void Merge(const TRestProcessProfile& profile);
+
+    /// Add the measurement of an event going through process **i**
+    inline void Fill(Int_t i, Double_t wall, Double_t cpu, Bool_t rejected) {
+        fEvents[i]++;
+        if (rejected) fRejected[i]++;
+        fWallTime[i] += wall;
+        fCPUTime[i] += cpu;
+        fWallHistograms[i][TimeBin(wall)]++;
+        fCPUHistograms[i][TimeBin(cpu)]++;
+    }
+    void SetThread(Int_t id, Long64_t events, Double_t lockWait);
+
+    static Double_t GetThreadCPUTime();
+
+    inline Int_t GetNumberOfProcesses() const { return fProcessNames.size(); }
+    inline std::string GetProcessName(Int_t i) const { return fProcessNames[i]; }
+    inline Long64_t GetEvents(Int_t i) const { return fEvents[i]; }
+    inline Long64_t GetRejected(Int_t i) const { return fRejected[i]; }
+    inline Double_t GetWallTime(Int_t i) const { return fWallTime[i]; }
+    inline Double_t GetCPUTime(Int_t i) const { return fCPUTime[i]; }
+    inline std::vector<Long64_t> GetWallHistogram(Int_t i) const { return fWallHistograms[i]; }
+    inline std::vector<Long64_t> GetCPUHistogram(Int_t i) const { return fCPUHistograms[i]; }
+    inline Int_t GetNumberOfThreads() const { return fThreadEvents.size(); }
+    inline Double_t GetThreadLockWait(Int_t id) const { return fThreadLockWait[id]; }
+
+    void PrintMetadata() override;
+
+    // Constructor
+    TRestProcessProfile();
+    // Destructor
+    ~TRestProcessProfile() {}
+
+    ClassDefOverride(TRestProcessProfile, 1);
+};
+#endif
@@ -1,18 +1,27 @@
 #ifndef RestCore_TRestProcessRunner
 #define RestCore_TRestProcessRunner
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
 #include <mutex>
+#include <set>
 #include <thread>
 
 #include "TRestAnalysisTree.h"
+#include "TRestBoundedQueue.h"
 #include "TRestEvent.h"
 #include "TRestEventProcess.h"
 #include "TRestMetadata.h"
+#include "TRestProcessProfile.h"
 #include "TRestRun.h"
 
 #define TIME_MEASUREMENT
 
+class TMemFile;
 class TRestThread;
+class TRestThreadPool;
 class TRestManager;
 
 enum ProcStatus {
@@ -24,6 +33,93 @@ enum ProcStatus {
     kFinished,  //!< finished state of process running
 };
 
+/// Event buffer filled ahead of time by the reader stage of the pipeline
+struct TRestEventSlot {
+    Long64_t fSequence = -1;
+    TRestEvent* fEvent = nullptr;
+    TRestAnalysisTree* fTree = nullptr;
+};
+
+/// Block of events read at once by a thread, see `dispatchChunkSize`
+struct TRestEventChunk {
+    std::vector<TRestEventSlot> fSlots;
+    size_t fSize = 0;  // number of events read in the slots
+    size_t fPos = 0;   // next event to be processed
+};
+
+/// Copy of the output of a thread, kept until it can be written in order
+struct TRestOutputRecord {
+    Long64_t fSequence = -1;
+    Bool_t fEmpty = true;  // the event was rejected by the process chain
+    std::vector<TRestEvent*> fEvents;
+    TTree* fEventTree = nullptr;
+    TRestAnalysisTree* fTree = nullptr;
+};
+
+/// Ordered stage running a single thread only process for all the threads, one event at a time
+class TRestSerialStage {
+   private:
+    std::mutex fMutex;
+    std::mutex fRunMutex;
+    std::condition_variable fCondition;
+    Long64_t fNextSequence = 0;
+    std::set<Long64_t> fSkipped;  // events rejected before reaching this stage
+    TRestEventProcess* fProcess;
+
+    void Advance() {
+        fNextSequence++;
+        while (fSkipped.erase(fNextSequence)) fNextSequence++;
+    }
+
+   public:
+    /// The process instance shared by all the threads
+    inline TRestEventProcess* GetProcess() const { return fProcess; }
+
+    /// Wait for the turn of the event with sequence number **seq**. A negative
+    /// number means the event is not ordered, e.g. in the test run.
+    void Enter(Long64_t seq) {
+        if (seq >= 0) {
+            std::unique_lock<std::mutex> lock(fMutex);
+            fCondition.wait(lock, [&] { return fNextSequence == seq; });
+        }
+        fRunMutex.lock();
+    }
+
+    /// Let the next event enter
+    void Leave(Long64_t seq) {
+        fRunMutex.unlock();
+        if (seq < 0) return;
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            Advance();
+        }
+        fCondition.notify_all();
+    }
+
+    /// Mark the event with sequence number **seq** as not reaching this stage
+    void Skip(Long64_t seq) {
+        if (seq < 0) return;
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            if (seq == fNextSequence) {
+                Advance();
+            } else if (seq > fNextSequence) {
+                fSkipped.insert(seq);
+            }
+        }
+        fCondition.notify_all();
+    }
+
+    /// Start again, with **seq** as the first sequence number
+    void Reset(Long64_t seq = 0) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fNextSequence = seq;
+        fSkipped.clear();
+    }
+
+    TRestSerialStage(TRestEventProcess* p) : fProcess(p) {}
+};
+
 /// Running the processes efficiently with fantastic display.
 class TRestProcessRunner : public TRestMetadata {
    private:
@@ -39,14 +135,73 @@ class TRestProcessRunner : public TRestMetadata {
     TFile* fOutputDataFile;              //! the TFile pointer being used
     TString fOutputDataFileName;  //! indicates the name of the first file created as output data file. The
                                   //! actual output file maybe changed if tree is too large
-    TTree* fEventTree;                 //!
-    TRestAnalysisTree* fAnalysisTree;  //!
-    ProcStatus fProcStatus;            //!
-    Int_t fNBranches;                  //!
-    Int_t fNFilesSplit;                //! Number of files being split.
+    TTree* fEventTree;                    //!
+    TRestAnalysisTree* fAnalysisTree;     //!
+    std::atomic<ProcStatus> fProcStatus;  //!
+    Int_t fNBranches;                     //!
+    Int_t fNFilesSplit;                   //! Number of files being split.
+
+    TRestThreadPool* fThreadPool;                   //!
+    std::vector<TRestSerialStage*> fSerialStages;  //! for each process, nullptr if it runs in parallel
+
+    // completion of the threads
+    Int_t fNRunningThreads;                    //!
+    std::mutex fFinishMutex;                   //! also guards fActiveThreads
+    std::condition_variable fFinishCondition;  //!
+    std::atomic<Long64_t> fLockWaitTime;       //! microseconds spent by the threads waiting for the i/o locks
+    TRestProcessProfile fProfile;              //! timing of the processes, merged from the threads
+
+    // state of threadNumber="auto", see AdjustThreadNumber()
+    std::condition_variable fThreadGateCondition;         //! wakes up the parked threads, with fFinishMutex
+    std::chrono::steady_clock::time_point fAutoLastTime;  //!
+    Int_t fAutoLastEvents;                                //!
+    Long64_t fAutoLastLockWait;                           //!
+    Double_t fAutoLastCPUTime;                            //!
+    Double_t fAutoLastRate;                               //!
+    Int_t fAutoLastStep;                                  //!
+    Int_t fAutoHold;                                      //! periods to wait before the next change
+    Double_t fAutoLevelTime;                              //! integral of the active threads over time
+    Double_t fAutoTotalTime;                              //!
+
+    // pipeline stages
+    Bool_t fPipelineActive;                              //!
+    Bool_t fWriterActive;                                //!
+    std::thread fReaderThread;                           //!
+    std::thread fWriterThread;                           //!
+    std::vector<TRestEventSlot> fEventSlots;             //!
+    TRestBoundedQueue<TRestEventSlot*>* fFreeSlots;      //! slots available to the reader
+    TRestBoundedQueue<TRestEventSlot*>* fReadySlots;     //! slots holding events ready to process
+    TRestBoundedQueue<TRestOutputRecord*>* fWriteQueue;  //! records waiting to be written
+    std::vector<TRestEventChunk> fEventChunks;           //! events read ahead by each thread
+
+    // output ordering
+    std::vector<TRestOutputRecord*> fOutputRecords;         //!
+    TRestBoundedQueue<TRestOutputRecord*>* fFreeRecords;    //!
+    std::map<Long64_t, TRestOutputRecord*> fReorderBuffer;  //! records parked until their turn
+    Long64_t fNextSequence;                                 //! sequence number of the next event read
+    Long64_t fNextWriteSequence;                            //! sequence number of the next event written
+    Bool_t fFlushing;                                       //!
+    std::mutex fReorderMutex;                               //!
+    std::condition_variable fReorderCondition;              //!
+
+    // checkpoints
+    Long64_t fResumedEntries;   //! entries already committed by the job being resumed
+    Int_t fResumedEvents;       //! events already written by the job being resumed
+    Bool_t fCheckpointPending;  //! a checkpoint is needed after the next event written
+
+    // id in the output tree of each observable of the threads, -1 if it is not saved
+    std::vector<Int_t> fOutputObservableIds;  //!
+
+    // output file rollover
+    std::thread fNextFileThread;   //! opens the next split file in advance
+    std::thread fCloseFileThread;  //! completes and closes the previous split file
+    TFile* fNextOutputFile;        //! split file opened before the output reaches fFileSplitSize
+    Bool_t fAsyncRollover;         //! the split files are opened and closed on helper threads
+    Bool_t fOwnGlobalMutex;        //! gGlobalMutex was created by RunProcess(), not by ROOT
 
     // metadata
     Bool_t fUseTestRun;
+    Bool_t fThreadFilesInMemory;
     Bool_t fUsePauseMenu;
     Bool_t fValidateObservables;
     Bool_t fSortOutputEvents;
@@ -54,14 +209,33 @@ class TRestProcessRunner : public TRestMetadata {
     Bool_t fInputEventStorage;
     Bool_t fOutputEventStorage;
     Bool_t fOutputAnalysisStorage;
+    Bool_t fUsePipeline;
+    Bool_t fAsyncOutput;
+    Int_t fPipelineDepth;       // number of events read ahead. 0: twice the thread number
+    Int_t fReorderBufferSize;   // number of output events kept for sorting. 0: automatic
+    Int_t fDispatchChunkSize;   // number of entries read by a thread at once
+    Int_t fCheckpointInterval;  // number of entries between checkpoints. 0: no checkpoints
+    Bool_t fResume;             // resume from the last checkpoint of the same output file
     Int_t fThreadNumber;
+    Bool_t fAutoThreadNumber;     // threadNumber="auto": the threads taking events are chosen at runtime
+    Int_t fActiveThreads;         // number of threads taking events, at the end of the run
+    std::string fThreadAffinity;  // none, compact, scatter or a cpu list
     Int_t fProcessNumber;
     Int_t fFirstEntry;
+    Int_t fLastEntry;  //! entries from this one on are never read, e.g. the end of a shard
     Int_t fEventsToProcess;
+    std::string fShard;  // "i/N": process the i-th of N consecutive parts of the entries
     Int_t fProcessedEvents;
 
-    Long64_t fFileSplitSize;  // in bytes
-    Int_t fFileCompression;   // 1~9
+    Long64_t fFileSplitSize;               // in bytes
+    Int_t fFileCompression;                // 1~9
+    std::string fEventTreeCompression;     // "ALG:level" of the EventTree, e.g. "ZSTD:5"
+    std::string fAnalysisTreeCompression;  // "ALG:level" of the AnalysisTree, e.g. "LZ4:4"
+    std::string fThreadFileCompression;    // "ALG:level" of the files of the threads
+    std::string fKeepObservables;          // observables saved, e.g. "sAna_*:hitsAna_energy", all if empty
+    std::string fDropObservables;          // observables not saved
+    std::string fKeepEventBranches;        // event branches saved, all if empty
+    std::string fDropEventBranches;        // event branches not saved
     std::map<std::string, std::string> fProcessInfo;
 
     // bool fOutputItem[4] = {
@@ -95,15 +269,53 @@ class TRestProcessRunner : public TRestMetadata {
     void ReadProcInfo();
     void RunProcess();
     void PauseMenu();
-    Int_t GetNextevtFunc(TRestEvent* targetevt, TRestAnalysisTree* targettree);
+    Int_t GetNextevtFunc(TRestEvent* targetevt, TRestAnalysisTree* targettree, Long64_t* seq = nullptr);
+    Int_t GetNextevtFunc(TRestThread* t);
+    size_t ReadEventChunk(TRestEventChunk& chunk);
+    void CreateEventChunks();
+    void DeleteEventChunks();
     void FillThreadEventFunc(TRestThread* t);
+    void ThreadStarted(TRestThread* t);
+    void ThreadFinished(TRestThread* t);
+    bool WaitForThreads(Int_t timeout = -1);
+    void WaitForThreadGate(TRestThread* t);
+    void AdjustThreadNumber();
+    void LockCounted(std::mutex& m);
+    void WriteThreadEvent(TRestThread* t);
+    void WriteOutputRecord(TRestOutputRecord* r);
+    void FillOutputTrees(TRestAnalysisTree* remotetree, TTree* remoteeventtree);
+    Bool_t CanSplitOutput();
+    void PrepareNextOutputFile();
+    void SwitchOutputFile();
+    void CloseSplitFile(TFile* file, TMemFile* metadata);
+    void StopRollover();
+    void CreateOutputRecords();
+    void DeleteOutputRecords();
+    void SaveToRecord(TRestThread* t, TRestOutputRecord* r);
+    void FlushReorderBuffer(std::unique_lock<std::mutex>& lock);
+    void WaitForReorderWindow(int nEvents);
+    void StartPipeline();
+    void StopPipeline();
+    void StartWriter();
+    void StopWriter();
+    void ReaderLoop();
+    void WriterLoop();
     void ConfigOutputFile();
     void MergeOutputFile();
+    void ApplyShard(Long64_t lastEntry);
+    void CheckpointAfter(Long64_t seq);
+    void WriteCheckpoint(Long64_t committedEntries);
+    Bool_t ResumeFromCheckpoint();
+    Bool_t TruncateTree(TFile* file, std::string treeName, Long64_t entries);
+    inline std::string GetCheckpointFileName() const {
+        return (std::string)fOutputDataFileName + ".checkpoint";
+    }
     void WriteMetadata();
 
     // tools
     void ResetRunTimes();
     TRestEventProcess* InstantiateProcess(TString type, TiXmlElement* ele);
+    TRestEventProcess* CloneProcess(TRestEventProcess* prototype);
     void PrintProcessedEvents(Int_t rateE);
     std::string MakeProgressBar(int progress100, int length = 100);
 
@@ -111,23 +323,39 @@ class TRestProcessRunner : public TRestMetadata {
     TRestEvent* GetInputEvent();
     TRestAnalysisTree* GetInputAnalysisTree();
     TRestAnalysisTree* GetOutputAnalysisTree() { return fAnalysisTree; }
+    inline TRestRun* GetRunInfo() const { return fRunInfo; }
     TFile* GetOutputDataFile() { return fOutputDataFile; }
     std::string GetProcInfo(std::string infoname) {
         return fProcessInfo[infoname] == "" ? infoname : fProcessInfo[infoname];
     }
     inline int GetNThreads() const { return fThreadNumber; }
+    inline int GetNActiveThreads() const { return fActiveThreads; }
+    inline const TRestProcessProfile& GetProcessProfile() const { return fProfile; }
     inline int GetNProcesses() const { return fProcessNumber; }
     inline int GetNProcessedEvents() const { return fProcessedEvents; }
     double GetReadingSpeed();
     bool UseTestRun() const { return fUseTestRun; }
+    bool UseThreadFilesInMemory() const { return fThreadFilesInMemory; }
     inline ProcStatus GetStatus() const { return fProcStatus; }
     inline Long64_t GetFileSplitSize() const { return fFileSplitSize; }
+    inline Bool_t IsPipelineActive() const { return fPipelineActive; }
+    inline std::string GetShard() const { return fShard; }
+    Bool_t GetShardIndex(Int_t& index, Int_t& nShards) const;
+    Int_t MergeShards(std::vector<std::string> files, std::string outputFileName);
+    static Int_t GetCompressionSettings(const std::string& compression, Int_t defaultLevel);
+    static std::string GetCompressionName(Int_t settings);
+    void SetObservableFilter(TRestAnalysisTree* tree) const;
+    Bool_t IsEventBranchKept(const std::string& branchName) const;
+    inline TRestSerialStage* GetSerialStage(int i) const {
+        return (fThreadNumber > 1 && i < (int)fSerialStages.size()) ? fSerialStages[i] : nullptr;
+    }
+    inline Bool_t IsWriterActive() const { return fWriterActive; }
 
     // Constructor & Destructor
     TRestProcessRunner();
     ~TRestProcessRunner();
 
-    ClassDefOverride(TRestProcessRunner, 7);
+    ClassDefOverride(TRestProcessRunner, 8);
 };
 
 #endif
@@ -7,13 +7,26 @@
 #include <TFile.h>
 #include <TFileMerger.h>
 #include <TKey.h>
+#include <TTreeCache.h>
+
+#include <atomic>
+#include <thread>
 
 #include "TRestAnalysisTree.h"
+#include "TRestBoundedQueue.h"
 #include "TRestEvent.h"
+#include "TRestFileWatcher.h"
 #include "TRestMetadata.h"
 
 class TRestEventProcess;
 
+/// Event decoded ahead from the external file process by the prefetch thread of TRestRun
+struct TRestPrefetchedEvent {
+    TRestEvent* fEvent = nullptr;
+    Long64_t fBytesRead = 0;  // bytes read by the file process once the event is decoded
+    Int_t fReader = 0;        // file reader which decoded the event, 0 being the file process itself
+};
+
 /// Data provider and manager in REST
 class TRestRun : public TRestMetadata {
    protected:
@@ -42,28 +55,57 @@ class TRestRun : public TRestMetadata {
     std::vector<TRestMetadata*> fInputMetadata;  //!
 
     // temp data members
-    std::vector<TString> fInputFileNames;  //!
-    TFile* fInputFile;                     //!
-    TFile* fOutputFile;                    //!
-    TRestEvent* fInputEvent;               //!
-    TTree* fEventTree;                     //!
-    TRestAnalysisTree* fAnalysisTree;      //!
-    bool fOverwrite;                       //!
-    bool fSaveHistoricData;                //!
-    TRestEventProcess* fFileProcess;       //!
-    int fCurrentEvent;                     //!
-    Long64_t fBytesRead;                   //!
-    Long64_t fTotalBytes;                  //!
-    int fEventBranchLoc;                   //!
-    int fEventIndexCounter = 0;            //!
-    bool fHangUpEndFile = false;           //!
-    bool fFromRML = false;                 //!
+    std::vector<TString> fInputFileNames;     //!
+    TFile* fInputFile;                        //!
+    TFile* fOutputFile;                       //!
+    TRestEvent* fInputEvent;                  //!
+    TTree* fEventTree;                        //!
+    TRestAnalysisTree* fAnalysisTree;         //!
+    bool fOverwrite;                          //!
+    bool fSaveHistoricData;                   //!
+    TRestEventProcess* fFileProcess;          //!
+    int fCurrentEvent;                        //!
+    Long64_t fBytesRead;                      //!
+    Long64_t fTotalBytes;                     //!
+    int fEventBranchLoc;                      //!
+    int fEventIndexCounter = 0;               //!
+    std::atomic<bool> fHangUpEndFile{false};  //!
+    TRestFileWatcher fFileWatcher;            //! wakes up the reader waiting for more input in hang-up mode
+    bool fFromRML = false;                    //!
+
+    // prefetch of the external file process
+    Int_t fPrefetchEvents;                                     //! events decoded ahead, 0: no prefetch
+    std::vector<std::thread> fPrefetchThreads;                 //! one for each file reader
+    std::atomic<int> fPrefetchRunning{0};                      //! prefetch threads still decoding
+    std::vector<TRestPrefetchedEvent> fPrefetchSlots;          //!
+    TRestBoundedQueue<TRestPrefetchedEvent*>* fPrefetchFree;   //! slots available to the prefetch thread
+    TRestBoundedQueue<TRestPrefetchedEvent*>* fPrefetchReady;  //! slots holding decoded events
+    TRestPrefetchedEvent* fPrefetchCurrent;                    //! slot holding the current fInputEvent
+
+    // concurrent reading of the input files of the external file process
+    Int_t fInputFileReaders;                       //! file processes decoding the input files at once
+    std::vector<TRestEventProcess*> fFileReaders;  //! copies of fFileProcess, each with its share of files
+    std::vector<Long64_t> fReaderBytesRead;        //! bytes read by each file reader
+
+    // cache of the input trees
+    Long64_t fTreeCacheSize;     //! bytes of TTreeCache for each input tree, 0: no cache
+    bool fAsyncPrefetch;         //! read the baskets of the input trees ahead on a background thread
+    Int_t fAsyncPrefetchingEnv;  //! TFile.AsyncPrefetching of gEnv to restore by CloseFile(), -1: unset
+    bool fLazyEventLoading;      //! read the data of the input events only when it is needed, see LoadEvent()
 
     void InitFromConfigFile() override;
 
    private:
     std::string ReplaceMetadataMember(const std::string& instr, Int_t precision = 0);
 
+    TRestEvent* ReadExternalEvent(TRestEventProcess* process);
+    TRestEvent* GetPrefetchedEvent();
+    void StartPrefetch();
+    void StopPrefetch();
+    void PrefetchLoop(Int_t reader);
+    Long64_t ReadEventBranch(Long64_t entry);
+    void SetLazyEvent(TRestEvent* event, Long64_t entry);
+
    public:
     /// REST run class
     void Initialize() override;
@@ -75,12 +117,14 @@ class TRestRun : public TRestMetadata {
     void ReadFileInfo(const std::string& filename);
     void ReadInputFileMetadata();
     void ReadInputFileTrees();
+    void ConfigureTreeCache();
 
     void ResetEntry();
 
     Int_t GetNextEvent(TRestEvent* targetEvent, TRestAnalysisTree* targetTree);
 
     void GetEntry(Long64_t entry);
+    void LoadEvent(TRestEvent* event);
 
     void GetNextEntry() {
         if (fCurrentEvent + 1 >= GetEntries()) fCurrentEvent = -1;
@@ -88,7 +132,8 @@ class TRestRun : public TRestMetadata {
     }
 
     TString FormFormat(const TString& FilenameFormat);
-    TFile* MergeToOutputFile(std::vector<std::string> filefullnames, std::string outputfilename = "");
+    TFile* MergeToOutputFile(std::vector<std::string> filefullnames, std::string outputfilename = "",
+                             std::vector<TFile*> files = {});
     TFile* FormOutputFile();
     TFile* UpdateOutputFile();
 
@@ -138,6 +183,7 @@ class TRestRun : public TRestMetadata {
     inline TString GetOutputFileName() const { return fOutputFileName; }
     inline TFile* GetInputFile() const { return fInputFile; }
     inline TFile* GetOutputFile() const { return fOutputFile; }
+    inline Int_t GetNFilesSplit() const { return fNFilesSplit; }
     inline int GetCurrentEntry() const { return fCurrentEvent; }
     inline Long64_t GetBytesReaded() const { return fBytesRead; }
     Long64_t GetTotalBytes();
@@ -146,8 +192,10 @@ class TRestRun : public TRestMetadata {
     /// Calling `GetInputEvent()` will return a basic `TRestEvent*`
     inline TRestEvent* GetInputEvent() const { return fInputEvent; }
     /// Calling `GetInputEvent<TRestGeant4Event>()` will return a `TRestGeant4Event*`
+    /// The data of the event is read if it was skipped by `lazyEventLoading`
     template <class T>
     inline T* GetInputEvent() {
+        if (fInputEvent != nullptr && fInputEvent->GetLazyEntry() >= 0) LoadEvent(fInputEvent);
         return static_cast<T*>(fInputEvent);
     }
 
@@ -164,6 +212,8 @@ class TRestRun : public TRestMetadata {
     inline TRestAnalysisTree* GetAnalysisTree() const { return fAnalysisTree; }
     inline TTree* GetEventTree() const { return fEventTree; }
     inline Int_t GetInputFileNumber() const { return fFileProcess == nullptr ? fInputFileNames.size() : 1; }
+    inline Bool_t IsPrefetchActive() const { return !fPrefetchThreads.empty(); }
+    Int_t GetNumberOfFileReaders() const;
 
     TRestMetadata* GetMetadata(const TString& name, TFile* file = nullptr);
     TRestMetadata* GetMetadataClass(const TString& type, TFile* file = nullptr);
@@ -183,7 +233,7 @@ class TRestRun : public TRestMetadata {
             TRestTools::GetFilesMatchingPattern((std::string)fInputFileName));
     }
     inline void SetOutputFileName(const std::string& s) { fOutputFileName = s; }
-    void SetExtProcess(TRestEventProcess* p);
+    void SetExtProcess(TRestEventProcess* p, const std::vector<TRestEventProcess*>& readers = {});
     inline void SetCurrentEntry(int i) { fCurrentEvent = i; }
     // void AddFileTask(TRestFileTask* t) { fFileTasks.push_back(t); }
     void SetInputEvent(TRestEvent* event);
@@ -204,11 +254,12 @@ class TRestRun : public TRestMetadata {
     inline void SetRunDescription(const TString& description) { fRunDescription = description; }
     inline void SetStartTimeStamp(Double_t timestamp) { fStartTime = timestamp; }
     inline void SetEndTimeStamp(Double_t timestamp) { fEndTime = timestamp; }
+    inline void SetEntriesSaved(Int_t entries) { fEntriesSaved = entries; }
     inline void SetTotalBytes(Long64_t totalBytes) { fTotalBytes = totalBytes; }
     inline void SetHistoricMetadataSaving(bool save) { fSaveHistoricData = save; }
     inline void SetNFilesSplit(int n) { fNFilesSplit = n; }
-    inline void HangUpEndFile() { fHangUpEndFile = true; }
-    inline void ReleaseEndFile() { fHangUpEndFile = false; }
+    void HangUpEndFile();
+    void ReleaseEndFile();
     // Printers
     void PrintStartDate();
     void PrintEndDate();
@@ -237,6 +288,7 @@ class TRestRun : public TRestMetadata {
     inline void PrintEvent() const { fInputEvent->PrintEvent(); }
     void PrintErrors();
     void PrintWarnings();
+    void PrintTreeCacheStatistics();
 
     Int_t Write(const char* name = nullptr, Int_t option = 0, Int_t bufsize = 0) override;
 
@@ -5,11 +5,14 @@
 #include <TFile.h>
 #include <TFileMerger.h>
 #include <TKey.h>
+#include <TMemFile.h>
 #include <TObject.h>
 #include <TString.h>
 #include <TTree.h>
 
+#include <atomic>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -18,7 +21,9 @@
 #include "TRestEvent.h"
 #include "TRestEventProcess.h"
 #include "TRestMetadata.h"
+#include "TRestProcessProfile.h"
 #include "TRestProcessRunner.h"
+#include "TRestThreadPool.h"
 
 /// Threaded worker of a process chain
 class TRestThread {
@@ -26,6 +31,7 @@ class TRestThread {
     Int_t fThreadId;
 
     TRestProcessRunner* fHostRunner;                //!
+    TRestThreadPool* fThreadPool;                   //!
     std::vector<TRestEventProcess*> fProcessChain;  //!
     TRestAnalysisTree* fAnalysisTree;               //!
     TRestEvent* fInputEvent;                        //!
@@ -34,9 +40,15 @@ class TRestThread {
     TTree* fEventTree;                              //!
 
     std::thread t;                                        //!
-    Bool_t isFinished;                                    //!
+    std::atomic<bool> isFinished;                         //!
     Bool_t fProcessNullReturned;                          //!
-    Int_t fCompressionLevel;                              //!
+    Long64_t fSequence;                                   //! sequence number of the current event
+    std::map<int, TRestEvent*> fSerialOutputEvents;       //! local copies of the serialized stages output
+    std::vector<TRestEvent*> fSavedEvents;                //! events with a branch in fEventTree
+    TRestProcessProfile fProfile;                         //! timing of the processes in this thread
+    Long64_t fNProcessedEvents;                           //!
+    Long64_t fLockWaitTime;                               //! microseconds waiting for the runner locks
+    Int_t fCompressionSettings;                           //!
     TRestStringOutput::REST_Verbose_Level fVerboseLevel;  //!
 
    public:
@@ -50,15 +62,28 @@ class TRestThread {
     void ProcessEvent();
     void EndProcess();
     void StartThread();
+    void OpenOutputFile(const std::string& fileName);
 
     Int_t ValidateChain(TRestEvent* input);
 
+    bool IsSerialReplica(int i) const;
+    TRestEvent* ProcessSerialized(int i, TRestEvent* input, bool validate = false);
+    TRestEvent* CopySerialOutput(int i, TRestEvent* output);
+    void SkipSerialStages(int i);
+    void LoadEventData(TRestEvent* event);
+
     // getter and setter
     void SetThreadId(Int_t id);
     inline void SetOutputTree(TRestAnalysisTree* t) { fAnalysisTree = t; }
     inline void SetProcessRunner(TRestProcessRunner* r) { fHostRunner = r; }
-    inline void SetCompressionLevel(Int_t comp) { fCompressionLevel = comp; }
+    inline void SetThreadPool(TRestThreadPool* p) {
+        fThreadPool = p;
+        for (auto process : fProcessChain) process->SetThreadPool(p);
+    }
+    inline void SetCompressionSettings(Int_t settings) { fCompressionSettings = settings; }
     inline void SetVerboseLevel(TRestStringOutput::REST_Verbose_Level verb) { fVerboseLevel = verb; }
+    inline void SetSequence(Long64_t seq) { fSequence = seq; }
+    inline void AddLockWaitTime(Long64_t us) { fLockWaitTime += us; }
 
     inline Int_t GetThreadId() const { return fThreadId; }
     inline TRestEvent* GetInputEvent() { return fInputEvent; }
@@ -68,7 +93,9 @@ class TRestThread {
     inline TRestEventProcess* GetProcess(int i) const { return fProcessChain[i]; }
     inline TRestAnalysisTree* GetAnalysisTree() const { return fAnalysisTree; }
     inline TTree* GetEventTree() { return fEventTree; }
-    inline Bool_t Finished() const { return isFinished; }
+    inline Bool_t Finished() const { return isFinished.load(); }
+    inline Long64_t GetSequence() const { return fSequence; }
+    inline const TRestProcessProfile& GetProfile() const { return fProfile; }
     inline TRestStringOutput::REST_Verbose_Level GetVerboseLevel() const { return fVerboseLevel; }
 
     // Constructor & Destructor
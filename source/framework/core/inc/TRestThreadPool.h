@@ -0,0 +1,72 @@
+/*************************************************************************
+ * This file is part of the REST software framework.                     *
+ *                                                                       *
+ * Copyright (C) 2016 GIFNA/TREX (University of Zaragoza)                *
+ * For more information see http://gifna.unizar.es/trex                  *
+ *                                                                       *
+ * REST is free software: you can redistribute it and/or modify          *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * REST is distributed in the hope that it will be useful,               *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have a copy of the GNU General Public License along with   *
+ * REST in $REST_PATH/LICENSE.                                           *
+ * If not, see http://www.gnu.org/licenses/.                             *
+ * For the list of contributors see $REST_PATH/CREDITS.                  *
+ *************************************************************************/
+
+#ifndef RestCore_TRestThreadPool
+#define RestCore_TRestThreadPool
+
+#include <Rtypes.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Pool of worker threads, optionally pinned to cpu cores, running the TRestThread process chains.
+/// It is never streamed, so it has no ClassDef.
+class TRestThreadPool {
+   private:
+    std::vector<std::thread> fWorkers;                           //!
+    std::vector<Int_t> fWorkerCpus;                              //! cpu of each worker, -1 if not pinned
+    std::deque<std::function<void()>> fTasks;                    //! tasks for any worker
+    std::vector<std::deque<std::function<void()>>> fLocalTasks;  //! tasks for a given worker
+    std::mutex fMutex;                                           //!
+    std::condition_variable fTaskCondition;                      //!
+    std::condition_variable fIdleCondition;                      //!
+    Int_t fNBusy;                                                //!
+    Bool_t fStop;                                                //!
+
+    void WorkerLoop(Int_t id);
+    bool HasTask(Int_t id) const;
+
+   public:
+    void Submit(std::function<void()> task, Int_t worker = -1);
+    void Wait();
+    void ParallelFor(Long64_t begin, Long64_t end, const std::function<void(Long64_t, Long64_t)>& body,
+                     Long64_t grain = 0);
+
+    inline Int_t GetNWorkers() const { return fWorkers.size(); }
+    inline Int_t GetWorkerCpu(Int_t id) const { return fWorkerCpus[id]; }
+
+    static std::vector<Int_t> GetAvailableCpus();
+    static std::vector<Int_t> GetCpuOrder(std::string affinity);
+    static std::vector<Int_t> ParseCpuList(std::string list);
+    static bool PinCurrentThread(Int_t cpu);
+
+    // Constructor & Destructor
+    TRestThreadPool(Int_t nWorkers, std::string affinity = "none");
+    ~TRestThreadPool();
+};
+
+#endif
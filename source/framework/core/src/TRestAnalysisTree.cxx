@@ -76,6 +76,9 @@
 #include <TH1F.h>
 #include <TLeaf.h>
 #include <TObjArray.h>
+#include <TVirtualIndex.h>
+
+#include <limits>
 
 #include "TRestStringHelper.h"
 #include "TRestStringOutput.h"
@@ -1119,6 +1122,164 @@ TTree* TRestAnalysisTree::GetTree() const {
     return (TTree*)fChain;
 }
 
+///////////////////////////////////////////////
+/// \brief Build the index of the entries on the event ID and sub-event ID
+///
+/// The index is saved together with the tree, so it is built once, when the
+/// tree is written, see GetEntryWithEventID(). It replaces any previous index.
+/// Returns the number of entries indexed, 0 if the index cannot be built.
+///
+/// The index of a chain (TChainIndex) needs the event IDs to be sorted across
+/// the files. If they are not, each file keeps its own index, see
+/// BuildFileIndices().
+///
+Int_t TRestAnalysisTree::BuildEventIndex() {
+    DeleteFileIndices();
+    TTree* tree = GetTree();
+    TVirtualIndex* index = tree->GetTreeIndex();
+    tree->SetTreeIndex(nullptr);
+    delete index;
+    if (tree->GetEntries() == 0) return 0;
+    Int_t n = tree->BuildIndex("eventID", "subEventID");
+    if (n <= 0 && fChain != nullptr) {
+        RESTDebug << "TRestAnalysisTree::BuildEventIndex(): the event IDs are not sorted across the files, "
+                     "using an index for each file"
+                  << RESTendl;
+        n = BuildFileIndices();
+    }
+    return n;
+}
+
+///////////////////////////////////////////////
+/// \brief Build the event index of each file of the chain
+///
+/// The index saved with the tree of the file is used if there is one. The
+/// indices are detached from the trees, so they are kept when the chain loads
+/// another file. Returns the number of entries indexed.
+///
+Int_t TRestAnalysisTree::BuildFileIndices() {
+    Int_t n = 0;
+    Long64_t current = fChain->GetReadEntry();
+    for (int i = 0; i < fChain->GetNtrees(); i++) {
+        TVirtualIndex* index = nullptr;
+        if (fChain->LoadTree(fChain->GetTreeOffset()[i]) >= 0) {
+            TTree* tree = fChain->GetTree();
+            if (tree->GetTreeIndex() == nullptr && tree->GetEntries() > 0) {
+                tree->BuildIndex("eventID", "subEventID");
+            }
+            index = tree->GetTreeIndex();
+            tree->SetTreeIndex(nullptr);
+            if (index != nullptr) n += tree->GetEntries();
+        }
+        fFileIndices.push_back(index);
+    }
+    if (current >= 0) fChain->LoadTree(current);
+    if (n == 0) DeleteFileIndices();
+    return n;
+}
+
+void TRestAnalysisTree::DeleteFileIndices() {
+    for (auto index : fFileIndices) delete index;
+    fFileIndices.clear();
+}
+
+///////////////////////////////////////////////
+/// \brief Returns the entry holding the given event ID and sub-event ID, or -1 if
+/// it is not found
+///
+/// The lookup uses the index saved with the tree. If the tree has no index, e.g.
+/// the files were written by an older version or it is a chain, it is built by
+/// the first call. With **subEventID** = -1 any sub-event of the event may be
+/// returned, the caller must check the event ID of the entry.
+///
+Long64_t TRestAnalysisTree::GetEntryWithEventID(Int_t eventID, Int_t subEventID) {
+    TTree* tree = GetTree();
+    if (!HasEventIndex() && BuildEventIndex() == 0) return -1;
+    const Int_t anySubEvent = std::numeric_limits<Int_t>::max();
+    if (fFileIndices.empty()) {
+        if (subEventID == -1) return tree->GetEntryNumberWithBestIndex(eventID, anySubEvent);
+        return tree->GetEntryNumberWithIndex(eventID, subEventID);
+    }
+
+    // the files are searched one by one
+    for (size_t i = 0; i < fFileIndices.size(); i++) {
+        TVirtualIndex* index = fFileIndices[i];
+        if (index == nullptr) continue;
+        Long64_t entry;
+        if (subEventID == -1) {
+            // the best entry is the last one not above the event ID. If it is also the best entry
+            // for the previous event ID, the event is not in this file
+            entry = index->GetEntryNumberWithBestIndex(eventID, anySubEvent);
+            if (entry >= 0 && entry == index->GetEntryNumberWithBestIndex(eventID - 1, anySubEvent)) {
+                entry = -1;
+            }
+        } else {
+            entry = index->GetEntryNumberWithIndex(eventID, subEventID);
+        }
+        if (entry >= 0) return fChain->GetTreeOffset()[i] + entry;
+    }
+    return -1;
+}
+
+///////////////////////////////////////////////
+/// \brief Set the observables saved in the output, as lists of names which may
+/// contain the wildcards `*` and `?`
+///
+/// An observable is active if it matches a pattern of **keep**, or **keep** is
+/// empty, and it does not match any pattern of **drop**. The observables used in
+/// the process chain, see AddRequiredObservable(), are always active.
+/// TRestProcessRunner only saves the active observables, and the processes may
+/// skip the computation of the other ones, see
+/// TRestEventProcess::IsObservableActive().
+///
+void TRestAnalysisTree::SetObservableFilter(const vector<string>& keep, const vector<string>& drop) {
+    fKeepObservables = keep;
+    fDropObservables = drop;
+    fActiveObservables.clear();
+}
+
+///////////////////////////////////////////////
+/// \brief Keep the given observable active whatever the filter, as it is used
+/// in the process chain
+///
+/// Returns true if IsObservableActive() had already returned false for it, so
+/// that it may not have been computed until now.
+///
+Bool_t TRestAnalysisTree::AddRequiredObservable(const string& obsName) {
+    if (!fRequiredObservables.insert(obsName).second) return false;
+    auto iter = fActiveObservables.find(obsName);
+    if (iter == fActiveObservables.end()) return false;
+    bool skipped = !iter->second;
+    fActiveObservables.erase(iter);
+    return skipped;
+}
+
+///////////////////////////////////////////////
+/// \brief Returns whether the given observable passes the filter set by
+/// SetObservableFilter()
+///
+/// The result is kept for each name, so that it can be called for every event.
+///
+Bool_t TRestAnalysisTree::IsObservableActive(const string& obsName) {
+    auto iter = fActiveObservables.find(obsName);
+    if (iter != fActiveObservables.end()) return iter->second;
+
+    bool active = fKeepObservables.empty();
+    for (const auto& pattern : fKeepObservables) {
+        if (MatchString(obsName, pattern)) {
+            active = true;
+            break;
+        }
+    }
+    for (const auto& pattern : fDropObservables) {
+        if (active && MatchString(obsName, pattern)) active = false;
+    }
+    if (fRequiredObservables.count(obsName) > 0) active = true;
+
+    fActiveObservables[obsName] = active;
+    return active;
+}
+
 /// <summary>
 /// Overrides TTree::LoadTree(), to set current tree according to the given entry number, in case of chain
 /// operation
@@ -1149,4 +1310,7 @@ Long64_t TRestAnalysisTree::GetEntries(const char* sel) {
     return fChain->GetEntries(sel);
 }
 
-TRestAnalysisTree::~TRestAnalysisTree() { delete fSubEventTag; }
+TRestAnalysisTree::~TRestAnalysisTree() {
+    DeleteFileIndices();
+    delete fSubEventTag;
+}
@@ -30,6 +30,29 @@
 /// virtual functions that must be implemented in derived classes
 /// like Initialize(), PrintEvent() or DrawEvent().
 ///
+/// Events are copied with CloneTo() for each event read or processed. A derived
+/// class avoids the streamer round trip of the default copy by implementing
+/// FastCopyTo() and FastSwap(), e.g.:
+///
+/// \code
+/// Bool_t TRestRawSignalEvent::FastCopyTo(TRestEvent* target) {
+///     auto event = (TRestRawSignalEvent*)target;
+///     CopyEventInfo(event);
+///     event->fSignal = fSignal;
+///     return true;
+/// }
+///
+/// Bool_t TRestRawSignalEvent::FastSwap(TRestEvent* target) {
+///     auto event = (TRestRawSignalEvent*)target;
+///     SwapEventInfo(event);
+///     fSignal.swap(event->fSignal);
+///     return true;
+/// }
+/// \endcode
+///
+/// MoveTo() uses FastSwap() when the source event is re-filled before it is
+/// read again, so that the data is handed over without copying.
+///
 ///
 ///--------------------------------------------------------------------------
 ///
@@ -49,6 +72,8 @@
 
 #include "TRestEvent.h"
 
+#include <utility>
+
 using namespace std;
 
 ClassImp(TRestEvent);
@@ -75,6 +100,7 @@ void TRestEvent::Initialize() {
     fSubEventTag = "";
     fOk = true;
     fPad = nullptr;
+    fLazyEntry = -1;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -91,8 +117,8 @@ void TRestEvent::SetTime(Double_t time) {
 //////////////////////////////////////////////////////////////////////////
 /// \brief Clone the content of this TRestEvent object to another
 ///
-/// This method uses default root streamer to do the copying. The efficiency is
-/// low. Override recommended.
+/// The copy is done by FastCopyTo() if the derived class implements it. Otherwise
+/// the default root streamer is used, whose efficiency is low.
 void TRestEvent::CloneTo(TRestEvent* target) {
     if (this->ClassName() != target->ClassName()) {
         cout << "In TRestEvent::CloneTo() : Event type doesn't match! (This :" << this->ClassName()
@@ -100,6 +126,10 @@ void TRestEvent::CloneTo(TRestEvent* target) {
         return;
     }
 
+    // the copy of an event whose data is not read yet must read it as well
+    target->fLazyEntry = fLazyEntry;
+    if (FastCopyTo(target)) return;
+
     TBufferFile buffer(TBuffer::kWrite);
     buffer.MapObject(this);  // register obj in map to handle self reference
     {
@@ -121,6 +151,48 @@ void TRestEvent::CloneTo(TRestEvent* target) {
     target->ResetBit(kCanDelete);
 }
 
+//////////////////////////////////////////////////////////////////////////
+/// \brief Hand the content of this TRestEvent object over to another
+///
+/// The content is exchanged by FastSwap() if the derived class implements it,
+/// and this event is left with the former content of **target**. Otherwise it is
+/// copied by CloneTo(). To be used when this event is re-filled before it is
+/// read again.
+void TRestEvent::MoveTo(TRestEvent* target) {
+    target->fLazyEntry = fLazyEntry;
+    if (this->ClassName() == target->ClassName() && FastSwap(target)) return;
+    CloneTo(target);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// \brief Copy the data members of TRestEvent to **target**
+///
+/// To be called by the FastCopyTo() implementation of the derived class.
+/// The drawing pad and the run reference of **target** are kept.
+void TRestEvent::CopyEventInfo(TRestEvent* target) const {
+    target->fRunOrigin = fRunOrigin;
+    target->fSubRunOrigin = fSubRunOrigin;
+    target->fEventID = fEventID;
+    target->fSubEventID = fSubEventID;
+    target->fSubEventTag = fSubEventTag;
+    target->fEventTime = fEventTime;
+    target->fOk = fOk;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// \brief Exchange the data members of TRestEvent with **target**
+///
+/// To be called by the FastSwap() implementation of the derived class.
+void TRestEvent::SwapEventInfo(TRestEvent* target) {
+    std::swap(fRunOrigin, target->fRunOrigin);
+    std::swap(fSubRunOrigin, target->fSubRunOrigin);
+    std::swap(fEventID, target->fEventID);
+    std::swap(fSubEventID, target->fSubEventID);
+    std::swap(fSubEventTag, target->fSubEventTag);
+    std::swap(fEventTime, target->fEventTime);
+    std::swap(fOk, target->fOk);
+}
+
 //////////////////////////////////////////////////////////////////////////
 /// Set the time of the event
 ///
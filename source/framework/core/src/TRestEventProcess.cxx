@@ -58,6 +58,7 @@
 
 #include "TRestManager.h"
 #include "TRestRun.h"
+#include "TRestThreadPool.h"
 
 using namespace std;
 
@@ -154,6 +155,30 @@ void TRestEventProcess::SetAnalysisTree(TRestAnalysisTree* tree) {
     fAnalysisTree = tree;
     if (fAnalysisTree == nullptr) return;
     ReadObservables();
+    // the observables of the cuts are computed even if they are not saved
+    fRequiredObservables.clear();
+    for (const auto& cut : fCuts) {
+        fAnalysisTree->AddRequiredObservable(cut.first);
+        fRequiredObservables.insert(cut.first);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// \brief Keep the observable **name**, read by this process, computed by the
+/// processes before it, even if it is not saved
+///
+/// It is called by GetObservableValue() the first time the observable is read,
+/// the names registered being kept in fRequiredObservables. The test run
+/// registers the observables read before the first event is processed.
+/// Otherwise, an observable not saved may have been skipped until it is first
+/// read, see IsObservableActive(), and the value read in that event is not valid.
+void TRestEventProcess::AddRequiredObservable(const string& name) {
+    fRequiredObservables.insert(name);
+    if (fAnalysisTree->AddRequiredObservable(name) && !fValidateObservables) {
+        RESTWarning << "The observable '" << name << "' read by " << this->GetName()
+                    << " is not saved and was not computed for this event. Add it to keepObservables"
+                    << RESTendl;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -229,6 +254,46 @@ Int_t TRestEventProcess::LoadSectionMetadata() {
     return 0;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/// \brief Copy the extra section metadata, observables and cuts, after
+/// calling TRestMetadata::CopySectionMetadata()
+///
+void TRestEventProcess::CopySectionMetadata(const TRestMetadata* prototype) {
+    TRestMetadata::CopySectionMetadata(prototype);
+
+    const TRestEventProcess* p = (const TRestEventProcess*)prototype;
+    fDynamicObs = p->fDynamicObs;
+    fCuts = p->fCuts;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// \brief Run a loop of the current event in parallel, on the idle workers of the process runner
+///
+/// The range [**begin**, **end**) is split in chunks of **grain** entries (by default,
+/// a few chunks per worker), and **body**(first, last) is called for each chunk. It
+/// returns when all the chunks are done. The workers are busy with their own events
+/// most of the time, so this mainly speeds up the very large events at the end of a
+/// run. Without multi-threading it simply calls **body**(begin, end).
+///
+/// The body may run concurrently for different chunks, so it must only write to the
+/// entries of its own chunk. Observables must be set after the loop. For example:
+///
+/// \code
+/// vector<Double_t> energy(fSignalEvent->GetNumberOfSignals());
+/// ParallelFor(0, energy.size(), [&](Long64_t first, Long64_t last) {
+///     for (Long64_t n = first; n < last; n++) energy[n] = fSignalEvent->GetSignal(n)->GetIntegral();
+/// });
+/// \endcode
+///
+void TRestEventProcess::ParallelFor(Long64_t begin, Long64_t end,
+                                    const function<void(Long64_t, Long64_t)>& body, Long64_t grain) {
+    if (fThreadPool == nullptr) {
+        if (end > begin) body(begin, end);
+        return;
+    }
+    fThreadPool->ParallelFor(begin, end, body, grain);
+}
+
 //////////////////////////////////////////////////////////////////////////
 /// \brief Get a metadata object from the host TRestRun
 ///
@@ -307,7 +372,7 @@ TRestEventProcess* TRestEventProcess::GetParallel(int i) {
 ///
 /// returns true if the event should be cut and not stored.
 bool TRestEventProcess::ApplyCut() {
-    for (auto cut : fCuts) {
+    for (const auto& cut : fCuts) {
         string type = (string)fAnalysisTree->GetObservableType(cut.first);
         if (fAnalysisTree != nullptr && type == "double") {
             double val = fAnalysisTree->GetObservableValue<double>(cut.first);
@@ -383,7 +448,8 @@ void TRestEventProcess::EndOfEventProcess(TRestEvent* inputEvent) {
     if (fValidateObservables) {
         if (fObservablesDefined.size() != fObservablesUpdated.size()) {
             for (auto x : fObservablesDefined) {
-                if (fObservablesUpdated.count(x.first) == 0) {
+                // an observable not saved may be skipped, see IsObservableActive()
+                if (fObservablesUpdated.count(x.first) == 0 && fAnalysisTree->IsObservableActive(x.first)) {
                     // the observable is added through <observable section but not set in the process
                     RESTWarning
                         << "The observable  '" << x.first << "' is defined but not set by "
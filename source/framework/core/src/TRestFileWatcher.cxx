@@ -0,0 +1,156 @@
+/*************************************************************************
+ * This file is part of the REST software framework.                     *
+ *                                                                       *
+ * Copyright (C) 2016 GIFNA/TREX (University of Zaragoza)                *
+ * For more information see http://gifna.unizar.es/trex                  *
+ *                                                                       *
+ * REST is free software: you can redistribute it and/or modify          *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * REST is distributed in the hope that it will be useful,               *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have a copy of the GNU General Public License along with   *
+ * REST in $REST_PATH/LICENSE.                                           *
+ * If not, see http://www.gnu.org/licenses/.                             *
+ * For the list of contributors see $REST_PATH/CREDITS.                  *
+ *************************************************************************/
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// TRestFileWatcher is used by TRestRun in hang-up mode, when the external file
+/// process reaches the end of its input and waits for the detector to write more
+/// data. Instead of checking again every second, the reader sleeps in Wait()
+/// until a watched file is written, or a new file appears in a watched
+/// directory.
+///
+/// On Linux the changes are notified by inotify. Wake() ends the wait from
+/// another thread, e.g. when a file is added or the run is released. Wait()
+/// always returns after the given timeout, so that changes which are not
+/// notified, e.g. written by another host on a network filesystem, are still
+/// found by polling. On other systems, or if the paths cannot be watched,
+/// Wait() just sleeps for the timeout.
+///
+///--------------------------------------------------------------------------
+///
+/// RESTsoft - Software for Rare Event Searches with TPCs
+///
+/// History of developments:
+///
+/// 2026-Oct: First implementation, replacing the one second polling of the
+///           hang-up mode of TRestRun
+///
+/// \class TRestFileWatcher
+///
+/// <hr>
+//////////////////////////////////////////////////////////////////////////
+
+#include "TRestFileWatcher.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <thread>
+
+TRestFileWatcher::TRestFileWatcher() {
+    fNotifyFd = -1;
+    fWakeFd[0] = -1;
+    fWakeFd[1] = -1;
+    fNWatches = 0;
+}
+
+TRestFileWatcher::~TRestFileWatcher() { Close(); }
+
+///////////////////////////////////////////////
+/// \brief Watch the given file for new data, or the given directory for new or
+/// modified files
+///
+/// Returns false if the path cannot be watched, the changes are then only found
+/// by polling.
+///
+Bool_t TRestFileWatcher::Watch(const std::string& path) {
+#ifdef __linux__
+    if (fNotifyFd < 0) {
+        fNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fNotifyFd < 0) return false;
+        if (pipe2(fWakeFd, O_NONBLOCK | O_CLOEXEC) != 0) {
+            fWakeFd[0] = -1;
+            fWakeFd[1] = -1;
+        }
+    }
+    if (inotify_add_watch(fNotifyFd, path.c_str(),
+                          IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) < 0) {
+        return false;
+    }
+    fNWatches++;
+    return true;
+#else
+    return false;
+#endif
+}
+
+///////////////////////////////////////////////
+/// \brief Wait until a watched path changes, Wake() is called, or **timeout**
+/// seconds have passed
+///
+/// Returns true if woken up by a change or by Wake(), false on timeout.
+///
+Bool_t TRestFileWatcher::Wait(Double_t timeout) {
+#ifdef __linux__
+    if (IsNotifying()) {
+        pollfd fds[2] = {{fNotifyFd, POLLIN, 0}, {fWakeFd[0], POLLIN, 0}};
+        int n = poll(fds, fWakeFd[0] >= 0 ? 2 : 1, (int)(timeout * 1000));
+        if (n <= 0) return false;
+
+        // the events are not needed, the reader just tries again
+        char buffer[4096];
+        while (read(fNotifyFd, buffer, sizeof(buffer)) > 0) {
+        }
+        if (fWakeFd[0] >= 0) {
+            while (read(fWakeFd[0], buffer, sizeof(buffer)) > 0) {
+            }
+        }
+        return true;
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+    return false;
+}
+
+///////////////////////////////////////////////
+/// \brief End the current or the next Wait(), from any thread
+///
+void TRestFileWatcher::Wake() {
+#ifdef __linux__
+    if (fWakeFd[1] >= 0) {
+        char c = 0;
+        if (write(fWakeFd[1], &c, 1) < 0) {
+            // the pipe is full, the waiting thread is woken up anyway
+        }
+    }
+#endif
+}
+
+///////////////////////////////////////////////
+/// \brief Stop watching all the paths
+///
+void TRestFileWatcher::Close() {
+#ifdef __linux__
+    if (fNotifyFd >= 0) close(fNotifyFd);
+    if (fWakeFd[0] >= 0) close(fWakeFd[0]);
+    if (fWakeFd[1] >= 0) close(fWakeFd[1]);
+#endif
+    fNotifyFd = -1;
+    fWakeFd[0] = -1;
+    fWakeFd[1] = -1;
+    fNWatches = 0;
+}
@@ -462,6 +462,7 @@
 
 #include <TFormula.h>
 #include <TMath.h>
+#include <TMethod.h>
 #include <TStreamerInfo.h>
 
 #include <iomanip>
@@ -667,6 +668,61 @@ Int_t TRestMetadata::LoadConfigFromElement(TiXmlElement* eSectional, TiXmlElemen
     return result;
 }
 
+///////////////////////////////////////////////
+/// \brief Load the same configuration as an already configured instance of this class.
+///
+/// The rml section of **prototype** has already been expanded and its variables
+/// replaced, so only InitFromConfigFile() is called. This is much faster than
+/// LoadConfigFromElement() when many copies of the same metadata are needed,
+/// e.g. the processes of each thread in TRestProcessRunner.
+///
+/// A class overriding LoadSectionMetadata() but not CopySectionMetadata() would
+/// miss its extra settings, so it is loaded from the rml section of
+/// **prototype** with LoadConfigFromElement() instead.
+///
+Int_t TRestMetadata::LoadConfigFromMetadata(const TRestMetadata* prototype) {
+    if (prototype == nullptr || prototype->fElement == nullptr) return -1;
+    if (prototype->IsA() != IsA()) {
+        RESTError << "cannot load config of " << ClassName() << " from a " << prototype->ClassName()
+                  << RESTendl;
+        return -1;
+    }
+
+    TMethod* load = IsA()->GetMethodAllAny("LoadSectionMetadata");
+    TMethod* copy = IsA()->GetMethodAllAny("CopySectionMetadata");
+    if (load != nullptr && copy != nullptr && load->GetClass() != copy->GetClass() &&
+        load->GetClass()->InheritsFrom(copy->GetClass())) {
+        RESTDebug << ClassName() << " does not override CopySectionMetadata(), loading its rml section"
+                  << RESTendl;
+        return LoadConfigFromElement(prototype->fElement, nullptr, prototype->fVariables);
+    }
+
+    Initialize();
+    CopySectionMetadata(prototype);
+    InitFromConfigFile();
+    RESTDebug << ClassName() << " has finished preparing config data" << RESTendl;
+    return 0;
+}
+
+///////////////////////////////////////////////
+/// \brief Copy the result of LoadSectionMetadata() from **prototype**
+///
+/// Derived classes overriding LoadSectionMetadata() shall also override this
+/// method to copy their extra settings.
+void TRestMetadata::CopySectionMetadata(const TRestMetadata* prototype) {
+    fElement = (TiXmlElement*)prototype->fElement->Clone();
+    fElementGlobal = prototype->fElementGlobal ? (TiXmlElement*)prototype->fElementGlobal->Clone() : nullptr;
+    fVariables = prototype->fVariables;
+    fConstants = prototype->fConstants;
+    fVerboseLevel = prototype->fVerboseLevel;
+
+    this->SetName(prototype->GetName());
+    this->SetTitle(prototype->GetTitle());
+    this->SetSectionName(this->ClassName());
+
+    fStore = prototype->fStore;
+}
+
 ///////////////////////////////////////////////
 /// \brief Initialize data from a string element buffer.
 ///
@@ -0,0 +1,210 @@
+/*************************************************************************
+ * This file is part of the REST software framework.                     *
+ *                                                                       *
+ * Copyright (C) 2016 GIFNA/TREX (University of Zaragoza)                *
+ * For more information see http://gifna.unizar.es/trex                  *
+ *                                                                       *
+ * REST is free software: you can redistribute it and/or modify          *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * REST is distributed in the hope that it will be useful,               *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have a copy of the GNU General Public License along with   *
+ * REST in $REST_PATH/LICENSE.                                           *
+ * If not, see http://www.gnu.org/licenses/.                             *
+ * For the list of contributors see $REST_PATH/CREDITS.                  *
+ *************************************************************************/
+
+//////////////////////////////////////////////////////////////////////////
+/// TRestProcessProfile keeps the timing of every process of the chain, as
+/// measured in each run by TRestThread, and is saved together with the other
+/// metadata of the output file by TRestProcessRunner.
+///
+/// For each process it records the number of events entering it, the number
+/// of events it rejected (cut or null returned), the total wall and cpu time
+/// and their distributions, as histograms with logarithmic bins. For each
+/// thread it records the number of events processed and the time spent
+/// waiting for the input and output locks of the runner. The measurement uses
+/// two clock readings per process and event, so it is always on, with any
+/// number of threads.
+///
+/// The hot process of a long chain is then found from the output file:
+///
+/// \code
+/// restRoot output.root
+/// [0] run0->GetMetadataClass("TRestProcessProfile")->PrintMetadata()
+/// \endcode
+///
+/// The time of a `singleThreadOnly` process includes the time it waits for the
+/// turn of the event, while its cpu time does not.
+///
+///--------------------------------------------------------------------------
+///
+/// RESTsoft - Software for Rare Event Searches with TPCs
+///
+/// \class TRestProcessProfile
+///
+/// <hr>
+///
+//////////////////////////////////////////////////////////////////////////
+
+#include "TRestProcessProfile.h"
+
+#include <time.h>
+
+#include <cmath>
+
+#include "TRestEventProcess.h"
+
+using namespace std;
+ClassImp(TRestProcessProfile);
+
+TRestProcessProfile::TRestProcessProfile() { Initialize(); }
+
+void TRestProcessProfile::Initialize() {
+    SetSectionName(this->ClassName());
+    SetName("ProcessProfile");
+    fProcessNames.clear();
+    fProcessTypes.clear();
+    fEvents.clear();
+    fRejected.clear();
+    fWallTime.clear();
+    fCPUTime.clear();
+    fWallHistograms.clear();
+    fCPUHistograms.clear();
+    fThreadEvents.clear();
+    fThreadLockWait.clear();
+}
+
+///////////////////////////////////////////////
+/// \brief Prepare one entry for each process of the given chain
+///
+void TRestProcessProfile::SetProcessChain(const vector<TRestEventProcess*>& chain) {
+    Initialize();
+    for (auto process : chain) {
+        fProcessNames.push_back(process->GetName());
+        fProcessTypes.push_back(process->ClassName());
+    }
+    fEvents.resize(chain.size(), 0);
+    fRejected.resize(chain.size(), 0);
+    fWallTime.resize(chain.size(), 0);
+    fCPUTime.resize(chain.size(), 0);
+    fWallHistograms.resize(chain.size(), vector<Long64_t>(kTimeBins, 0));
+    fCPUHistograms.resize(chain.size(), vector<Long64_t>(kTimeBins, 0));
+}
+
+///////////////////////////////////////////////
+/// \brief Add the measurements of another profile of the same process chain,
+/// e.g. the one of another thread
+///
+void TRestProcessProfile::Merge(const TRestProcessProfile& profile) {
+    if (fProcessNames.empty()) {
+        fProcessNames = profile.fProcessNames;
+        fProcessTypes = profile.fProcessTypes;
+        fEvents.resize(fProcessNames.size(), 0);
+        fRejected.resize(fProcessNames.size(), 0);
+        fWallTime.resize(fProcessNames.size(), 0);
+        fCPUTime.resize(fProcessNames.size(), 0);
+        fWallHistograms.resize(fProcessNames.size(), vector<Long64_t>(kTimeBins, 0));
+        fCPUHistograms.resize(fProcessNames.size(), vector<Long64_t>(kTimeBins, 0));
+    }
+    if (profile.fProcessNames != fProcessNames) {
+        RESTWarning << "TRestProcessProfile: cannot merge the profile of a different process chain"
+                    << RESTendl;
+        return;
+    }
+    for (unsigned int i = 0; i < fProcessNames.size(); i++) {
+        fEvents[i] += profile.fEvents[i];
+        fRejected[i] += profile.fRejected[i];
+        fWallTime[i] += profile.fWallTime[i];
+        fCPUTime[i] += profile.fCPUTime[i];
+        for (int j = 0; j < kTimeBins; j++) {
+            fWallHistograms[i][j] += profile.fWallHistograms[i][j];
+            fCPUHistograms[i][j] += profile.fCPUHistograms[i][j];
+        }
+    }
+    for (unsigned int id = 0; id < profile.fThreadEvents.size(); id++) {
+        if (profile.fThreadEvents[id] > 0 || profile.fThreadLockWait[id] > 0)
+            SetThread(id, profile.fThreadEvents[id], profile.fThreadLockWait[id]);
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Set the number of events processed by the thread **id** and the time
+/// it spent waiting for the locks
+///
+void TRestProcessProfile::SetThread(Int_t id, Long64_t events, Double_t lockWait) {
+    if (id >= (Int_t)fThreadEvents.size()) {
+        fThreadEvents.resize(id + 1, 0);
+        fThreadLockWait.resize(id + 1, 0);
+    }
+    fThreadEvents[id] = events;
+    fThreadLockWait[id] = lockWait;
+}
+
+///////////////////////////////////////////////
+/// \brief Returns the cpu time used by the calling thread, in seconds
+///
+Double_t TRestProcessProfile::GetThreadCPUTime() {
+#ifdef WIN32
+    return (Double_t)clock() / CLOCKS_PER_SEC;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.e9;
+#endif
+}
+
+Int_t TRestProcessProfile::TimeBin(Double_t seconds) {
+    Double_t us = seconds * 1.e6;
+    if (us < 1) return 0;
+    Int_t bin = ilogb(us) + 1;
+    return bin < kTimeBins ? bin : kTimeBins - 1;
+}
+
+///////////////////////////////////////////////
+/// \brief Returns the upper edge, in seconds, of the bin containing the quantile
+/// **q** of the given time histogram
+///
+Double_t TRestProcessProfile::Quantile(const vector<Long64_t>& histogram, Double_t q) const {
+    Long64_t total = 0;
+    for (auto n : histogram) total += n;
+    Long64_t sum = 0;
+    for (int i = 0; i < (int)histogram.size(); i++) {
+        sum += histogram[i];
+        if (sum >= q * total) return ldexp(1.e-6, i);
+    }
+    return 0;
+}
+
+void TRestProcessProfile::PrintMetadata() {
+    TRestMetadata::PrintMetadata();
+
+    Double_t totalWall = 0;
+    for (auto t : fWallTime) totalWall += t;
+
+    RESTMetadata << "Process timing (wall time per event in ms, median and 99% below the given value):"
+                 << RESTendl;
+    for (unsigned int i = 0; i < fProcessNames.size(); i++) {
+        Long64_t n = fEvents[i] > 0 ? fEvents[i] : 1;
+        RESTMetadata << fProcessTypes[i] << " (" << fProcessNames[i] << ")" << RESTendl;
+        RESTMetadata << "    events : " << fEvents[i] << ", rejected : " << fRejected[i] << " ("
+                     << 100. * fRejected[i] / n << "%)" << RESTendl;
+        RESTMetadata << "    wall : " << fWallTime[i] / n * 1000 << " (median < "
+                     << Quantile(fWallHistograms[i], 0.5) * 1000 << ", 99% < "
+                     << Quantile(fWallHistograms[i], 0.99) * 1000 << "), cpu : " << fCPUTime[i] / n * 1000
+                     << ", share of the chain : " << (totalWall > 0 ? 100. * fWallTime[i] / totalWall : 0)
+                     << "%" << RESTendl;
+    }
+    RESTMetadata << " " << RESTendl;
+    for (unsigned int id = 0; id < fThreadEvents.size(); id++) {
+        RESTMetadata << "Thread " << id << " : " << fThreadEvents[id] << " events, " << fThreadLockWait[id]
+                     << " s waiting for the locks" << RESTendl;
+    }
+    RESTMetadata << "+++" << RESTendl;
+}
@@ -22,26 +22,40 @@
 /// <hr>
 //////////////////////////////////////////////////////////////////////////
 
+#include "Compression.h"
 #include "Math/MinimizerOptions.h"
+#include "TBranchElement.h"
 #include "TBranchRef.h"
 #include "TInterpreter.h"
+#include "TKey.h"
+#include "TMemFile.h"
+#include "TMethod.h"
 #include "TMinuitMinimizer.h"
 #include "TMutex.h"
 #include "TROOT.h"
 #include "TRestManager.h"
 #include "TRestThread.h"
+#include "TRestThreadPool.h"
 
 #ifdef WIN32
 #include <io.h>
 #else
+#include <sys/resource.h>
+
 #include "unistd.h"
 #endif  // !WIN32
 
-std::mutex mutex_write;
+std::mutex mutex_write;    // protects output trees and files
+std::mutex mutex_nextevt;  // protects input reading
+
+// the TRestThread running on this thread, see ThreadStarted()
+thread_local TRestThread* currentThread = nullptr;
+
+#include <chrono>
+#include <fstream>
 
 using namespace std;
 #ifdef TIME_MEASUREMENT
-#include <chrono>
 using namespace std::chrono;
 int deltaTime;
 int writeTime;
@@ -53,6 +67,18 @@ int ncalculated = 10;
 Long64_t bytesReaded_last = 0;
 Double_t prog_last = 0;
 Int_t prog_last_printed = 0;
+
+// cpu time used by the whole process, in seconds
+Double_t GetProcessCPUTime() {
+#ifdef WIN32
+    return (Double_t)clock() / CLOCKS_PER_SEC;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1.e6;
+#endif
+}
 vector<Long64_t> bytesAdded(ncalculated, 0);
 vector<Double_t> progAdded(ncalculated, 0);
 int poscalculated = 0;
@@ -77,11 +103,51 @@ void TRestProcessRunner::Initialize() {
     fOutputDataFile = nullptr;
     fOutputDataFileName = "";
 
+    fThreadPool = nullptr;
+    fSerialStages.clear();
+    fNRunningThreads = 0;
+
+    fPipelineActive = false;
+    fWriterActive = false;
+    fFreeSlots = nullptr;
+    fReadySlots = nullptr;
+    fWriteQueue = nullptr;
+    fEventSlots.clear();
+
+    fEventChunks.clear();
+
+    fFreeRecords = nullptr;
+    fOutputRecords.clear();
+    fReorderBuffer.clear();
+    fNextSequence = 0;
+    fNextWriteSequence = 0;
+    fFlushing = false;
+    fResumedEntries = 0;
+    fResumedEvents = 0;
+    fCheckpointPending = false;
+    fNextOutputFile = nullptr;
+    fAsyncRollover = false;
+    fOwnGlobalMutex = false;
+
     fThreads.clear();
     fProcessInfo.clear();
 
     fThreadNumber = 0;
+    fAutoThreadNumber = false;
+    fActiveThreads = 0;
+    fLockWaitTime = 0;
+    fAutoLastEvents = 0;
+    fAutoLastLockWait = 0;
+    fAutoLastCPUTime = 0;
+    fAutoLastRate = 0;
+    fAutoLastStep = 0;
+    fAutoHold = 0;
+    fAutoLevelTime = 0;
+    fAutoTotalTime = 0;
+    fThreadAffinity = "none";
     fFirstEntry = 0;
+    fLastEntry = REST_MAXIMUM_EVENTS;
+    fShard = "";
     fNFilesSplit = 0;
     fEventsToProcess = 0;
     fProcessedEvents = 0;
@@ -89,11 +155,26 @@ void TRestProcessRunner::Initialize() {
     fProcStatus = kNormal;
     fFileSplitSize = 10000000000LL;  // 10GB maximum
     fFileCompression = 2;            // default compression level
+    fEventTreeCompression = "";
+    fAnalysisTreeCompression = "";
+    fThreadFileCompression = "";
+    fKeepObservables = "";
+    fDropObservables = "";
+    fKeepEventBranches = "";
+    fDropEventBranches = "";
 
     fUseTestRun = true;
+    fThreadFilesInMemory = true;
     fUsePauseMenu = true;
     fValidateObservables = false;
     fSortOutputEvents = true;
+    fUsePipeline = false;
+    fAsyncOutput = false;
+    fPipelineDepth = 0;
+    fReorderBufferSize = 0;
+    fDispatchChunkSize = 1;
+    fCheckpointInterval = 0;
+    fResume = false;
     fInputAnalysisStorage = true;
     fInputEventStorage = true;
     fOutputEventStorage = true;
@@ -106,9 +187,15 @@ void TRestProcessRunner::Initialize() {
 /// It first checks if a friendly TRestRun object is initialized in
 /// TRestManager, if so, it reads the following configuration items:
 /// 1. firstEntry, lastEntry, eventsToProcess. These indicates how many events
-/// we need to process.
+/// we need to process. eventsToProcess is the number of input entries read from
+/// firstEntry, whatever the processes cut, so the output may have fewer events.
+/// It has the same meaning with `dispatchChunkSize` and `usePipeline`. With
+/// shard="i/N" only the i-th part of these entries is processed, see
+/// ApplyShard().
 /// 2. Tree branch list. can be inputAnalysis, inputEvent, outputEvent.
 /// 3. Number of thread needed. A list TRestThread will then be instantiated.
+/// With threadNumber="auto" there is one thread per cpu core, and the number of
+/// them taking events is adjusted at runtime, see AdjustThreadNumber().
 void TRestProcessRunner::BeginOfInit() {
     RESTInfo << RESTendl;
     if (fHostmgr != nullptr) {
@@ -141,6 +228,8 @@ void TRestProcessRunner::BeginOfInit() {
     // firstEntry = StringToInteger(GetParameter("firstEntry", "0"));
     // eventsToProcess = StringToInteger(GetParameter("eventsToProcess", "0"));
     int lastEntry = StringToInteger(GetParameter("lastEntry", "0"));
+    // an explicit lastEntry is a hard limit, even if the processes cut some events
+    fLastEntry = lastEntry > fFirstEntry ? lastEntry : REST_MAXIMUM_EVENTS;
     if (lastEntry - fFirstEntry > 0 && fEventsToProcess == 0) {
         fEventsToProcess = lastEntry - fFirstEntry;
     } else if (fEventsToProcess > 0 && lastEntry - fFirstEntry > 0 &&
@@ -157,6 +246,7 @@ void TRestProcessRunner::BeginOfInit() {
         fFirstEntry = fFirstEntry > 0 ? fFirstEntry : 0;
         lastEntry = lastEntry == fFirstEntry + fEventsToProcess ? lastEntry : REST_MAXIMUM_EVENTS;
     }
+    if (fShard != "") ApplyShard(lastEntry);
     fRunInfo->SetCurrentEntry(fFirstEntry);
 
     if (fFileSplitSize < 50000000LL || fFileSplitSize > 100000000000LL) {
@@ -173,6 +263,15 @@ void TRestProcessRunner::BeginOfInit() {
         RESTError << "output analysis must be turned on to process data!" << RESTendl;
         exit(1);
     }
+    if ((fCheckpointInterval > 0 || fResume) && fRunInfo->GetFileProcess() != nullptr) {
+        RESTWarning << "checkpoints need a REST input file, they are disabled" << RESTendl;
+        fCheckpointInterval = 0;
+        fResume = false;
+    }
+    if (fCheckpointInterval > 0 && !fSortOutputEvents) {
+        RESTWarning << "checkpoints need sortOutputEvents to be ON, they are disabled" << RESTendl;
+        fCheckpointInterval = 0;
+    }
     // fValidateObservables = StringToBool(GetParameter("validateObservables", "OFF"));
     // fSortOutputEvents = StringToBool(GetParameter("sortOutputEvents", "ON"));
     // fThreadNumber = StringToDouble(GetParameter("threadNumber", "1"));
@@ -183,15 +282,33 @@ void TRestProcessRunner::BeginOfInit() {
 
     // fOutputItem = Split(GetParameter("treeBranches",
     // "inputevent:outputevent:inputanalysis"), ":");
+    // the number of cores is 0 when it cannot be determined
+    const Int_t nCores = max(1u, std::thread::hardware_concurrency());
+    fAutoThreadNumber = ToUpper(GetParameter("threadNumber", "1")) == "AUTO";
+    if (fAutoThreadNumber) fThreadNumber = nCores;
     if (fThreadNumber < 1) fThreadNumber = 1;
-    if (fThreadNumber > 15) fThreadNumber = 15;
+    if (fThreadNumber > nCores) {
+        RESTWarning << "TRestProcessRunner: " << fThreadNumber << " threads requested, but only " << nCores
+                    << " cpu cores are available" << RESTendl;
+    }
+
+    // the compression actually used is recorded, e.g. "ZSTD:5"
+    for (auto compression : {&fEventTreeCompression, &fAnalysisTreeCompression, &fThreadFileCompression}) {
+        Int_t settings = GetCompressionSettings(*compression, fFileCompression);
+        if (settings < 0) {
+            RESTWarning << "invalid compression \"" << *compression << "\", using the level "
+                        << fFileCompression << " of fileCompression" << RESTendl;
+            settings = fFileCompression;
+        }
+        *compression = GetCompressionName(settings);
+    }
 
     for (int i = 0; i < fThreadNumber; i++) {
         TRestThread* t = new TRestThread();
         t->SetProcessRunner(this);
         t->SetVerboseLevel(fVerboseLevel);
         t->SetThreadId(i);
-        t->SetCompressionLevel(fFileCompression);
+        t->SetCompressionSettings(GetCompressionSettings(fThreadFileCompression, fFileCompression));
         fThreads.push_back(t);
     }
 }
@@ -201,9 +318,9 @@ void TRestProcessRunner::BeginOfInit() {
 ///
 /// If child element is declared as "addProcess", then multiple new process will
 /// be instantiated using sequential startup method, by calling
-/// InstantiateProcess() The processes will be added into each TRestThread
-/// instance. If the process is external process, then it will be sent to
-/// TRestRun.
+/// InstantiateProcess() for the first thread and CloneProcess() for the others.
+/// The processes will be added into each TRestThread instance. If the process
+/// is external process, then it will be sent to TRestRun.
 Int_t TRestProcessRunner::ReadConfig(string keydeclare, TiXmlElement* e) {
     if (keydeclare == "addProcess") {
         string active = GetParameter("value", e, "");
@@ -224,20 +341,26 @@ Int_t TRestProcessRunner::ReadConfig(string keydeclare, TiXmlElement* e) {
         RESTInfo << "adding process " << processType << " \"" << processName << "\"" << RESTendl;
         vector<TRestEventProcess*> processes;
         for (int i = 0; i < fThreadNumber; i++) {
-            TRestEventProcess* p = InstantiateProcess(processType, e);
+            // the rml section is parsed once, the other threads get a copy of the first process
+            TRestEventProcess* p = i == 0 ? InstantiateProcess(processType, e) : CloneProcess(processes[0]);
             if (p != nullptr) {
                 if (p->isExternal()) {
-                    fRunInfo->SetExtProcess(p);
+                    // copies of the process decode the other input files at the same time
+                    vector<TRestEventProcess*> readers;
+                    for (int r = 1; r < fRunInfo->GetNumberOfFileReaders(); r++) {
+                        TRestEventProcess* reader = CloneProcess(p);
+                        if (reader != nullptr) readers.push_back(reader);
+                    }
+                    fRunInfo->SetExtProcess(p, readers);
                     return 0;
                 }
-                if ((p->GetVerboseLevel() >= TRestStringOutput::REST_Verbose_Level::REST_Debug ||
-                     p->singleThreadOnly())) {
+                if (p->GetVerboseLevel() >= TRestStringOutput::REST_Verbose_Level::REST_Debug) {
                     fUsePauseMenu = false;
                     fProcStatus = kIgnore;
                     if (fThreadNumber > 1) {
                         RESTInfo << "multi-threading is disabled due to process \"" << p->GetName() << "\""
                                  << RESTendl;
-                        RESTInfo << "This process is in debug mode or is single thread only" << RESTendl;
+                        RESTInfo << "This process is in debug mode" << RESTendl;
                         for (i = fThreadNumber; i > 1; i--) {
                             // delete (*fThreads.end());
                             fThreads.erase(fThreads.end() - 1);
@@ -251,10 +374,27 @@ Int_t TRestProcessRunner::ReadConfig(string keydeclare, TiXmlElement* e) {
             }
         }
 
+        // A single thread only process runs in its own serialized stage. The
+        // instance of the first thread processes the events of all the threads
+        // one at a time, in the order they were read. The other processes of
+        // the chain still run in parallel.
+        if (processes[0]->singleThreadOnly()) {
+            fUsePauseMenu = false;
+            fProcStatus = kIgnore;
+            if (fThreadNumber > 1) {
+                RESTInfo << "process \"" << processes[0]->GetName()
+                         << "\" is single thread only, it will run in a serialized stage" << RESTendl;
+            }
+            fSerialStages.resize(fProcessNumber + 1, nullptr);
+            fSerialStages[fProcessNumber] = new TRestSerialStage(processes[0]);
+        }
+
+        // the replicas of a serialized stage get no event, the instance of the stage
+        // then has no parallel processes, as in a single thread run
         for (int i = 0; i < fThreadNumber; i++) {
             TRestEventProcess* p = processes[i];
             for (int j = 0; j < fThreadNumber; j++) {
-                p->SetParallelProcess(processes[j]);
+                if (!p->singleThreadOnly() || j == i) p->SetParallelProcess(processes[j]);
             }
             fThreads[i]->AddProcess(p);
         }
@@ -336,16 +476,26 @@ void TRestProcessRunner::ReadProcInfo() {
 void TRestProcessRunner::RunProcess() {
     RESTDebug << "Creating output File " << fRunInfo->GetOutputFileName() << RESTendl;
 
+    // the split files are opened and closed on helper threads, see SwitchOutputFile(). It needs ROOT
+    // to be thread safe, which gives each thread its own gDirectory and locks the list of files of
+    // gROOT. As it cannot be undone, it is only enabled if the output may be split
+    fAsyncRollover = gGlobalMutex != nullptr || CanSplitOutput();
+    if (fAsyncRollover) ROOT::EnableThreadSafety();
+
     TString filename = fRunInfo->FormFormat(fRunInfo->GetOutputFileName());
     fOutputDataFileName = filename;
-    fOutputDataFile = new TFile(filename, "recreate");
-    // set compression level here will cause problem in pipeline
-    // we must set in each threadCompression
-    // fOutputDataFile->SetCompressionLevel(fFile);
+    fResumedEntries = 0;
+    fResumedEvents = 0;
+    bool resumed = fResume && ResumeFromCheckpoint();
+    if (!resumed) fOutputDataFile = new TFile(filename, "recreate");
     if (!fOutputDataFile->IsOpen()) {
         RESTError << "Failed to create output file: " << fOutputDataFile->GetName() << RESTendl;
         exit(1);
     }
+    // the branches take the compression of the file when they are created, which
+    // is the one of the analysis tree. The event tree is set below
+    Int_t settings = GetCompressionSettings(fAnalysisTreeCompression, fFileCompression);
+    fOutputDataFile->SetCompressionSettings(settings);
     RESTInfo << RESTendl;
     RESTInfo << "TRestProcessRunner : preparing threads..." << RESTendl;
     fRunInfo->ResetEntry();
@@ -391,6 +541,10 @@ void TRestProcessRunner::RunProcess() {
         fEventTree->SetMaxTreeSize(100000000000LL > fFileSplitSize * 2
                                        ? 100000000000LL
                                        : fFileSplitSize * 2);  // the default size is 100GB
+        settings = GetCompressionSettings(fEventTreeCompression, fFileCompression);
+        for (int i = 0; i < fEventTree->GetListOfBranches()->GetEntriesFast(); i++) {
+            ((TBranch*)fEventTree->GetListOfBranches()->At(i))->SetCompressionSettings(settings);
+        }
     } else {
         fEventTree = nullptr;
     }
@@ -398,6 +552,8 @@ void TRestProcessRunner::RunProcess() {
     // initialize analysis tree
     fAnalysisTree = new TRestAnalysisTree("AnalysisTree", "REST Process Analysis Tree");
     fAnalysisTree->SetDirectory(fOutputDataFile);
+    SetObservableFilter(fAnalysisTree);
+    fOutputObservableIds.clear();
     fAnalysisTree->SetMaxTreeSize(100000000000LL > fFileSplitSize * 2 ? 100000000000LL : fFileSplitSize * 2);
 
     tree = fThreads[0]->GetAnalysisTree();
@@ -408,20 +564,22 @@ void TRestProcessRunner::RunProcess() {
         exit(1);
     }
 
-    ConfigOutputFile();
+    // a resumed job keeps the metadata written by the previous one until the end
+    if (!resumed) ConfigOutputFile();
 
     // reset runner
     this->ResetRunTimes();
-    fProcessedEvents = 0;
+    fProcessedEvents = fResumedEvents;
     fRunInfo->ResetEntry();
-    fRunInfo->SetCurrentEntry(fFirstEntry);
+    fRunInfo->SetCurrentEntry(fFirstEntry + fResumedEntries);
     inputtreeentries = fRunInfo->GetEntries();
 
     // set root mutex
     //!!!!!!!!!!!!Important!!!!!!!!!!!!
     ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit");
     TMinuitMinimizer::UseStaticMinuit(false);
-    if (gGlobalMutex == nullptr) {
+    fOwnGlobalMutex = gGlobalMutex == nullptr;
+    if (fOwnGlobalMutex) {
         gGlobalMutex = new TMutex(true);
         gROOTMutex = gGlobalMutex;
         gInterpreterMutex = gGlobalMutex;
@@ -431,14 +589,52 @@ void TRestProcessRunner::RunProcess() {
     high_resolution_clock::time_point t3 = high_resolution_clock::now();
 #endif
 
+    // the sequence numbers count the entries from firstEntry, including the resumed ones
+    fNextSequence = fResumedEntries;
+    fNextWriteSequence = fResumedEntries;
+    fCheckpointPending = false;
+    for (auto stage : fSerialStages) {
+        if (stage != nullptr) stage->Reset(fResumedEntries);
+    }
+    if (fUsePipeline || fAsyncOutput || fSortOutputEvents) {
+        CreateOutputRecords();
+    }
+    if (fUsePipeline || fAsyncOutput) {
+        StartWriter();
+    }
+    if (fUsePipeline) {
+        StartPipeline();
+    }
+    if (!fPipelineActive && fDispatchChunkSize > 1) {
+        CreateEventChunks();
+    }
+
+    fThreadPool = new TRestThreadPool(fThreadNumber, fThreadAffinity);
+
+    // with threadNumber="auto" we start with half of the threads, then AdjustThreadNumber() takes over
+    fActiveThreads = fAutoThreadNumber ? (fThreadNumber + 1) / 2 : fThreadNumber;
+    fLockWaitTime = 0;
+    fAutoLastTime = std::chrono::steady_clock::now();
+    fAutoLastEvents = fProcessedEvents;
+    fAutoLastLockWait = 0;
+    fAutoLastCPUTime = GetProcessCPUTime();
+    fAutoLastRate = 0;
+    fAutoLastStep = 0;
+    fAutoHold = 0;
+    fAutoLevelTime = 0;
+    fAutoTotalTime = 0;
+
     // start the thread!
     RESTcout << this->ClassName() << ": Starting the Process.." << RESTendl;
+    fNRunningThreads = fThreadNumber;
     for (int i = 0; i < fThreadNumber; i++) {
+        fThreads[i]->SetThreadPool(fThreadPool);
         fThreads[i]->StartThread();
     }
 
-    while (fProcStatus == kPause ||
-           (fRunInfo->GetInputEvent() != nullptr && fEventsToProcess > fProcessedEvents)) {
+    // the progress is updated every printInterval, or at once when the threads have finished
+    bool finished = false;
+    while (!finished) {
         PrintProcessedEvents(100);
 
         if (fProcStatus == kNormal && Console::kbhit())  // if keyboard inputs
@@ -466,7 +662,8 @@ void TRestProcessRunner::RunProcess() {
             break;
         }
 
-        usleep(printInterval);
+        finished = WaitForThreads(printInterval);
+        if (!finished) AdjustThreadNumber();
 
         // cout << eventsToProcess << " " << fProcessedEvents << " " << lastEntry <<
         // " " << fCurrentEvent << endl; cout << fProcessedEvents << "\r";
@@ -477,16 +674,25 @@ void TRestProcessRunner::RunProcess() {
         while (getchar() != '\n')
             ;  // clear buffer
 
-    RESTEssential << "Waiting for processes to finish ..." << RESTendl;
+    if (!finished) {
+        RESTEssential << "Waiting for processes to finish ..." << RESTendl;
+        WaitForThreads();
+    }
 
-    while (1) {
-        usleep(100000);
-        bool finish = fThreads[0]->Finished();
-        for (int i = 1; i < fThreadNumber; i++) {
-            finish = finish && fThreads[i]->Finished();
-        }
-        if (finish) break;
+    for (int i = 0; i < fThreadNumber; i++) {
+        fThreads[i]->SetThreadPool(nullptr);
     }
+    delete fThreadPool;
+    fThreadPool = nullptr;
+
+    if (fPipelineActive) {
+        StopPipeline();
+    }
+    if (fWriterActive) {
+        StopWriter();
+    }
+    DeleteEventChunks();
+    DeleteOutputRecords();
 
     // make dummy analysis tree filled with observables
     fAnalysisTree->GetEntry(fAnalysisTree->GetEntries() - 1);
@@ -499,18 +705,35 @@ void TRestProcessRunner::RunProcess() {
     }
     fProcStatus = kFinished;
 
+    fProfile.Initialize();
+    fProfile.SetVerboseLevel(fVerboseLevel);
+    for (int i = 0; i < fThreadNumber; i++) {
+        fProfile.Merge(fThreads[i]->GetProfile());
+    }
+
 #ifdef TIME_MEASUREMENT
     high_resolution_clock::time_point t4 = high_resolution_clock::now();
     deltaTime = (int)duration_cast<microseconds>(t4 - t3).count();
 #endif
 
-    // reset the mutex to null
-    delete gGlobalMutex;
-    gGlobalMutex = nullptr;
-    gROOTMutex = nullptr;
-    gInterpreterMutex = nullptr;
+    // the split files use the ROOT mutex
+    StopRollover();
+
+    // reset the mutex to null, unless it is the one of ROOT::EnableThreadSafety()
+    if (fOwnGlobalMutex) {
+        delete gGlobalMutex;
+        gGlobalMutex = nullptr;
+        gROOTMutex = nullptr;
+        gInterpreterMutex = nullptr;
+        fOwnGlobalMutex = false;
+    }
 
     RESTcout << this->ClassName() << ": " << fProcessedEvents << " processed events" << RESTendl;
+    if (fAutoThreadNumber) {
+        double average = fAutoTotalTime > 0 ? fAutoLevelTime / fAutoTotalTime : fActiveThreads;
+        RESTcout << this->ClassName() << ": " << fActiveThreads << " of " << fThreadNumber
+                 << " threads active at the end (average " << average << ")" << RESTendl;
+    }
 
 #ifdef TIME_MEASUREMENT
     RESTInfo << "Total processing time : " << ((Double_t)deltaTime) / 1000. << " ms" << RESTendl;
@@ -523,11 +746,20 @@ void TRestProcessRunner::RunProcess() {
              << ((Double_t)writeTime) / fProcessedEvents / 1000. << " ms" << RESTendl;
     RESTInfo << "=" << RESTendl;
 #endif
+    if (fVerboseLevel >= TRestStringOutput::REST_Verbose_Level::REST_Info) {
+        fProfile.PrintMetadata();
+        fRunInfo->PrintTreeCacheStatistics();
+    }
 
     if (fRunInfo->GetOutputFileName() != "/dev/null") {
         ConfigOutputFile();
         MergeOutputFile();
     }
+
+    // the output is complete, the checkpoint is not needed any more
+    if (TRestTools::fileExists(GetCheckpointFileName())) {
+        remove(GetCheckpointFileName().c_str());
+    }
 }
 
 ///////////////////////////////////////////////
@@ -662,6 +894,14 @@ void TRestProcessRunner::PauseMenu() {
 #ifdef WIN32
             RESTWarning << "fork not available on windows!" << RESTendl;
 #else
+            if (fPipelineActive || fWriterActive || fRunInfo->IsPrefetchActive()) {
+                Console::CursorUp(infobar);
+                RESTLog.setcolor(COLOR_BOLDYELLOW);
+                RESTLog << "cannot detach when running with pipeline, prefetch or asynchronous output!"
+                        << RESTendl;
+                RESTLog.setcolor(COLOR_BOLDWHITE);
+                break;
+            }
             pid_t pid;
             pid = fork();
             if (pid < 0) {
@@ -672,8 +912,12 @@ void TRestProcessRunner::PauseMenu() {
             if (pid == 0) {
                 RESTcout << "Child process created! pid: " << getpid() << RESTendl;
                 RESTInfo << "Restarting threads" << RESTendl;
-                mutex_write.unlock();
+                mutex_nextevt.unlock();
+                // the workers of the thread pool do not survive fork(), leave it
+                fThreadPool = nullptr;
+                fNRunningThreads = fThreadNumber;
                 for (int i = 0; i < fThreadNumber; i++) {
+                    fThreads[i]->SetThreadPool(nullptr);
                     fThreads[i]->StartThread();
                 }
                 RESTInfo << "Re-directing output to " << file << RESTendl;
@@ -699,6 +943,11 @@ void TRestProcessRunner::PauseMenu() {
             break;
         } else if (b == 'q') {
             fProcStatus = kStopping;
+            {
+                // the parked threads must see the stop
+                std::lock_guard<std::mutex> lock(fFinishMutex);
+                fThreadGateCondition.notify_all();
+            }
             break;
         } else if (b == 'p') {
             Console::CursorUp(menuupper);
@@ -728,7 +977,8 @@ void TRestProcessRunner::PauseMenu() {
 /// the local analysis tree.
 ///
 /// This method is locked by mutex. There can never be two of it running
-/// simultaneously in two threads.
+/// simultaneously in two threads. The lock is different from the one of
+/// FillThreadEventFunc(), so reading and writing events do not block each other.
 ///
 /// If there is a single thread process, the local input event will be set to
 /// the out put of this process. The **targettree** will not be changed.
@@ -740,20 +990,48 @@ void TRestProcessRunner::PauseMenu() {
 /// Finally the data in the input event will get cloned to the **targetevt** by
 /// root streamer.
 ///
+/// In pipeline mode, the event has already been read by the reader stage. It is
+/// taken from the queue of ready events without locking, see ReaderLoop().
+///
+/// Each event read gets a sequence number, which is saved in **seq**. It is
+/// used to write the output events in the order of the input.
+///
 /// If the current entry is the last entry of the input tree, or the single
 /// thread process stops to give a concret pointer as the output, the process is
 /// over. This method returns -1.
 ///
-Int_t TRestProcessRunner::GetNextevtFunc(TRestEvent* targetevt, TRestAnalysisTree* targettree) {
-    mutex_write.lock();  // lock on
+Int_t TRestProcessRunner::GetNextevtFunc(TRestEvent* targetevt, TRestAnalysisTree* targettree,
+                                         Long64_t* seq) {
+    if (fPipelineActive) {
+        TRestEventSlot* slot = nullptr;
+        if (targetevt == nullptr || fProcStatus == kStopping || !fReadySlots->Pop(slot)) {
+            return -1;
+        }
+        targetevt->Initialize();
+        slot->fEvent->MoveTo(targetevt);
+        if (fInputAnalysisStorage && targettree != nullptr) {
+            targettree->SetEventInfo(slot->fTree);
+            for (int n = 0; n < slot->fTree->GetNumberOfObservables(); n++)
+                targettree->SetObservable(n, slot->fTree->GetObservable(n));
+        }
+        if (seq != nullptr) *seq = slot->fSequence;
+        fFreeSlots->Push(slot);
+        return 0;
+    }
+
+    LockCounted(mutex_nextevt);  // lock on
     while (fProcStatus == kPause) {
         usleep(100000);
     }
+    WaitForReorderWindow(1);
 #ifdef TIME_MEASUREMENT
     high_resolution_clock::time_point t1 = high_resolution_clock::now();
 #endif
     int n;
-    if (fProcessedEvents >= fEventsToProcess || targetevt == nullptr || fProcStatus == kStopping) {
+    // the events of the test run (without seq) are read again, so they are not counted
+    bool lastEntryReached =
+        seq != nullptr && (fNextSequence >= fEventsToProcess || fFirstEntry + fNextSequence >= fLastEntry);
+    if (lastEntryReached || targetevt == nullptr || fProcStatus == kStopping) {
         n = -1;
     } else {
         if (fInputAnalysisStorage == false) {
@@ -761,174 +1039,941 @@ Int_t TRestProcessRunner::GetNextevtFunc(TRestEvent* targetevt, TRestAnalysisTre
         } else {
             n = fRunInfo->GetNextEvent(targetevt, targettree);
         }
+        if (n == 0) {
+            if (seq != nullptr) *seq = fNextSequence;
+            fNextSequence++;
+        }
     }
 
 #ifdef TIME_MEASUREMENT
     high_resolution_clock::time_point t2 = high_resolution_clock::now();
     readTime += (int)duration_cast<microseconds>(t2 - t1).count();
 #endif
-    mutex_write.unlock();
+    mutex_nextevt.unlock();
     return n;
 }
 
+///////////////////////////////////////////////
+/// \brief Get next event for the given thread, and save its sequence number
+/// in the thread.
+///
+/// If `dispatchChunkSize` is larger than 1, the thread reads a block of
+/// contiguous entries at once, see ReadEventChunk(). The following calls just
+/// take the events from the block, without any lock. This reduces the overhead
+/// for light process chains, e.g. when re-processing only the observables of
+/// the AnalysisTree.
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="threadNumber" value="8"/>
+///     <parameter name="dispatchChunkSize" value="100"/>
+///     ...
+/// \endcode
+///
+/// The events of a block have contiguous sequence numbers, so the output is
+/// still sorted if `sortOutputEvents` is ON. The option has no effect in
+/// pipeline mode, where the events are already read by the reader stage.
+Int_t TRestProcessRunner::GetNextevtFunc(TRestThread* t) {
+    // a thread is only parked once the events it has read are processed
+    if (fAutoThreadNumber) {
+        int id = t->GetThreadId();
+        if (fEventChunks.empty() || fEventChunks[id].fPos >= fEventChunks[id].fSize) WaitForThreadGate(t);
+    }
+    if (fEventChunks.empty()) {
+        Long64_t seq = -1;
+        Int_t n = GetNextevtFunc(t->GetInputEvent(), t->GetAnalysisTree(), &seq);
+        t->SetSequence(seq);
+        return n;
+    }
+
+    TRestEventChunk& chunk = fEventChunks[t->GetThreadId()];
+    if (chunk.fPos >= chunk.fSize && ReadEventChunk(chunk) == 0) {
+        return -1;
+    }
+
+    TRestEventSlot& slot = chunk.fSlots[chunk.fPos];
+    chunk.fPos++;
+
+    TRestEvent* targetevt = t->GetInputEvent();
+    targetevt->Initialize();
+    slot.fEvent->MoveTo(targetevt);
+    TRestAnalysisTree* targettree = t->GetAnalysisTree();
+    if (fInputAnalysisStorage && targettree != nullptr) {
+        targettree->SetEventInfo(slot.fTree);
+        for (int n = 0; n < slot.fTree->GetNumberOfObservables(); n++)
+            targettree->SetObservable(n, slot.fTree->GetObservable(n));
+    }
+    t->SetSequence(slot.fSequence);
+    return 0;
+}
+
+///////////////////////////////////////////////
+/// \brief Read a block of entries into the given chunk, within a single lock
+///
+/// It returns the number of events read, which is 0 at the end of the input.
+size_t TRestProcessRunner::ReadEventChunk(TRestEventChunk& chunk) {
+    LockCounted(mutex_nextevt);  // lock on
+    while (fProcStatus == kPause) {
+        usleep(100000);
+    }
+    WaitForReorderWindow(chunk.fSlots.size());
+#ifdef TIME_MEASUREMENT
+    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+#endif
+    chunk.fSize = 0;
+    chunk.fPos = 0;
+    while (chunk.fSize < chunk.fSlots.size()) {
+        // eventsToProcess counts the entries read, see BeginOfInit()
+        if (fNextSequence >= fEventsToProcess || fFirstEntry + fNextSequence >= fLastEntry ||
+            fProcStatus == kStopping) {
+            break;
+        }
+        TRestEventSlot& slot = chunk.fSlots[chunk.fSize];
+        if (fRunInfo->GetNextEvent(slot.fEvent, fInputAnalysisStorage ? slot.fTree : nullptr) != 0) {
+            break;
+        }
+        slot.fSequence = fNextSequence;
+        fNextSequence++;
+        chunk.fSize++;
+    }
+#ifdef TIME_MEASUREMENT
+    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    readTime += (int)duration_cast<microseconds>(t2 - t1).count();
+#endif
+    mutex_nextevt.unlock();
+    return chunk.fSize;
+}
+
+///////////////////////////////////////////////
+/// \brief Create the event buffers of each thread for chunked dispatch
+///
+void TRestProcessRunner::CreateEventChunks() {
+    if (fRunInfo->GetInputEvent() == nullptr) {
+        return;
+    }
+    fEventChunks.resize(fThreadNumber);
+    for (int i = 0; i < fThreadNumber; i++) {
+        fEventChunks[i].fSlots.resize(fDispatchChunkSize);
+        for (int j = 0; j < fDispatchChunkSize; j++) {
+            TRestEventSlot& slot = fEventChunks[i].fSlots[j];
+            slot.fEvent = (TRestEvent*)fRunInfo->GetInputEvent()->Clone();
+            slot.fTree =
+                new TRestAnalysisTree("AnalysisTree_chunk" + ToString(i) + "_" + ToString(j), "dummyTree");
+            slot.fTree->SetDirectory(nullptr);
+            slot.fTree->DisableQuickObservableValueSetting();
+        }
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Delete the event buffers of chunked dispatch
+///
+void TRestProcessRunner::DeleteEventChunks() {
+    for (auto& chunk : fEventChunks) {
+        for (auto& slot : chunk.fSlots) {
+            delete slot.fEvent;
+            delete slot.fTree;
+        }
+    }
+    fEventChunks.clear();
+}
+
 ///////////////////////////////////////////////
 /// \brief Calling back the FillEvent() method in TRestThread.
 ///
 /// This method is locked by mutex. There can never be two of it running
 /// simultaneously in two threads. As a result threads will not write their
 /// files together, thus preventing segmentaion violation.
+///
+/// If `sortOutputEvents` is ON, the output events are written in the order
+/// of their sequence numbers, i.e. in the order they were read. It is the order
+/// of the input, except for an external file process with `inputFileReaders` > 1,
+/// whose files are decoded concurrently, see TRestRun::SetExtProcess(). A thread
+/// whose event is not the next one to be written saves a copy of its output in
+/// the reorder buffer, and goes on with the next event. The parked outputs are
+/// flushed by the thread which writes the missing event. There is no busy
+/// waiting.
+///
+/// If the writer thread is running (`asyncOutput` ON or pipeline mode) the
+/// output is always copied and handed to it, see WriterLoop().
 void TRestProcessRunner::FillThreadEventFunc(TRestThread* t) {
-    if (fSortOutputEvents) {
-        // Make sure the thread has the minimum event id in the all the
-        // threads. Otherwise just wait.
-        while (1) {
-            bool smallest = true;
-            for (TRestThread* otherT : fThreads) {
-                if (otherT->Finished()) {
-                    continue;
-                }
-                if (t->GetThreadId() == otherT->GetThreadId()) {
-                    continue;
-                }
-                int id1 = t->GetInputEvent()->GetID();
-                int id2 = otherT->GetInputEvent()->GetID();
-                if (id1 > id2) {
-                    smallest = false;
-                } else if (id1 == id2) {
-                    cout << "warning! Two events with same event id! output events maybe dis-ordered!"
-                         << endl;
-                }
-            }
+    if (fWriterActive) {
+        TRestOutputRecord* record = nullptr;
+        if (!fFreeRecords->Pop(record)) return;
+        SaveToRecord(t, record);
+        if (!fWriteQueue->Push(record)) fFreeRecords->Push(record);
+        return;
+    }
 
-            if (smallest) break;
-            usleep(1);
+    if (fSortOutputEvents) {
+        std::unique_lock<std::mutex> lock(fReorderMutex);
+        if (t->GetSequence() != fNextWriteSequence) {
+            // not our turn yet. Park a copy of the output event.
+            lock.unlock();
+            TRestOutputRecord* record = nullptr;
+            fFreeRecords->Pop(record);
+            SaveToRecord(t, record);
+            lock.lock();
+            fReorderBuffer[record->fSequence] = record;
+            FlushReorderBuffer(lock);
+            return;
         }
+        lock.unlock();
+
+        LockCounted(mutex_write);
+        WriteThreadEvent(t);
+        CheckpointAfter(t->GetSequence());
+        mutex_write.unlock();
+
+        lock.lock();
+        fNextWriteSequence++;
+        fReorderCondition.notify_all();
+        FlushReorderBuffer(lock);
+        return;
     }
 
     // Start event saving, entering mutex lock region.
-    mutex_write.lock();
+    LockCounted(mutex_write);
+    WriteThreadEvent(t);
+    mutex_write.unlock();
+}
+
+///////////////////////////////////////////////
+/// \brief Called by a TRestThread when it has finished processing events
+///
+void TRestProcessRunner::ThreadFinished(TRestThread* t) {
+    std::lock_guard<std::mutex> lock(fFinishMutex);
+    fNRunningThreads--;
+    fFinishCondition.notify_all();
+    fThreadGateCondition.notify_all();
+}
+
+///////////////////////////////////////////////
+/// \brief Wait until all the threads have finished, at most for **timeout**
+/// microseconds. A negative timeout means no limit.
+///
+/// It returns true if all the threads have finished.
+bool TRestProcessRunner::WaitForThreads(Int_t timeout) {
+    std::unique_lock<std::mutex> lock(fFinishMutex);
+    if (timeout < 0) {
+        fFinishCondition.wait(lock, [&] { return fNRunningThreads <= 0; });
+        return true;
+    }
+    return fFinishCondition.wait_for(lock, std::chrono::microseconds(timeout),
+                                     [&] { return fNRunningThreads <= 0; });
+}
+
+///////////////////////////////////////////////
+/// \brief Keep the given thread waiting while it is not among the active
+/// threads of threadNumber="auto".
+///
+/// The thread sleeps until AdjustThreadNumber() activates it. All the threads
+/// are released when a thread finishes, i.e. at the end of the input, or when
+/// the run is stopped.
+void TRestProcessRunner::WaitForThreadGate(TRestThread* t) {
+    std::unique_lock<std::mutex> lock(fFinishMutex);
+    fThreadGateCondition.wait(lock, [&] {
+        return t->GetThreadId() < fActiveThreads || fNRunningThreads != fThreadNumber ||
+               fProcStatus == kStopping;
+    });
+}
+
+///////////////////////////////////////////////
+/// \brief Lock the given i/o mutex, counting the time spent waiting for it.
+///
+/// The time is only measured when the lock is busy, so that the usual case
+/// costs a single try_lock(). It is added to the total of the runner and to
+/// the TRestThread running on the calling thread, if any.
+void TRestProcessRunner::LockCounted(std::mutex& m) {
+    if (m.try_lock()) return;
+    auto t1 = std::chrono::steady_clock::now();
+    m.lock();
+    auto t2 = std::chrono::steady_clock::now();
+    Long64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+    fLockWaitTime += wait;
+    if (currentThread != nullptr) currentThread->AddLockWaitTime(wait);
+}
+
+///////////////////////////////////////////////
+/// \brief Called by the thread **t** when it starts processing, on the thread
+/// running it
+///
+void TRestProcessRunner::ThreadStarted(TRestThread* t) { currentThread = t; }
+
+///////////////////////////////////////////////
+/// \brief Choose the number of threads taking events, with threadNumber="auto"
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="threadNumber" value="auto"/>
+///     ...
+/// \endcode
+///
+/// One thread is created per cpu core, and half of them start taking events.
+/// About every second the runner measures the event rate, the fraction of
+/// time the active threads spent waiting for the input and output locks, and
+/// the cpu load of the process per active thread. Then:
+///
+/// * if the threads wait for the locks more than 25% of the time, one thread
+/// is parked, as more threads would only queue on the locks.
+/// * if the last thread added did not raise the rate by 5%, or the last thread
+/// parked lowered it by 5%, the change is undone and the level is kept for a
+/// few periods.
+/// * otherwise, if the active threads keep the cpu busy (75% or more), one more
+/// thread is activated.
+///
+/// Parked threads wait before taking a new event, so they never hold an event
+/// needed by the ordered output. The level at the end of the run and its time
+/// average are reported when the run finishes.
+void TRestProcessRunner::AdjustThreadNumber() {
+    if (!fAutoThreadNumber || (fProcStatus != kNormal && fProcStatus != kIgnore)) return;
+
+    auto now = std::chrono::steady_clock::now();
+    double wall = std::chrono::duration<double>(now - fAutoLastTime).count();
+    Int_t events = fProcessedEvents - fAutoLastEvents;
+    // wait for enough statistics: one second and a few events per thread
+    if (wall < 1 || events < 2 * fActiveThreads) return;
+
+    Long64_t lockWait = fLockWaitTime;
+    Double_t cpuTime = GetProcessCPUTime();
+    double rate = events / wall;
+    double waitFraction = (lockWait - fAutoLastLockWait) / 1.e6 / (wall * fActiveThreads);
+    double cpuLoad = (cpuTime - fAutoLastCPUTime) / (wall * fActiveThreads);
+
+    fAutoLevelTime += fActiveThreads * wall;
+    fAutoTotalTime += wall;
+    fAutoLastTime = now;
+    fAutoLastEvents = fProcessedEvents;
+    fAutoLastLockWait = lockWait;
+    fAutoLastCPUTime = cpuTime;
+
+    int step = 0;
+    if (fAutoHold > 0) {
+        fAutoHold--;
+    } else if (waitFraction > 0.25) {
+        step = -1;
+    } else if (fAutoLastStep > 0 && rate < fAutoLastRate * 1.05) {
+        step = -1;
+        fAutoHold = 5;
+    } else if (fAutoLastStep < 0 && rate < fAutoLastRate * 0.95) {
+        step = 1;
+        fAutoHold = 5;
+    } else if (cpuLoad > 0.75) {
+        step = 1;
+    }
+    if (fActiveThreads + step < 1 || fActiveThreads + step > fThreadNumber) step = 0;
+
+    RESTDebug << "TRestProcessRunner: " << rate << " events/s with " << fActiveThreads
+              << " threads, lock wait " << waitFraction * 100 << "%, cpu load " << cpuLoad * 100 << "%"
+              << RESTendl;
+
+    fAutoLastRate = rate;
+    fAutoLastStep = step;
+    if (step != 0) {
+        std::lock_guard<std::mutex> lock(fFinishMutex);
+        fActiveThreads += step;
+        fThreadGateCondition.notify_all();
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Save the output event and observables of the given thread in the
+/// output trees.
+///
+/// It must be called either inside the lock of FillThreadEventFunc() or from
+/// the writer stage.
+void TRestProcessRunner::WriteThreadEvent(TRestThread* t) {
+    if (t->GetOutputEvent() == nullptr) return;
+
+    fOutputEvent = t->GetOutputEvent();
+    if (fAnalysisTree != nullptr) {
+        fAnalysisTree->SetEventInfo(fOutputEvent);
+    }
+    FillOutputTrees(t->GetAnalysisTree(), t->GetEventTree());
+}
+
+///////////////////////////////////////////////
+/// \brief Save the output event and observables kept in the given record in
+/// the output trees.
+void TRestProcessRunner::WriteOutputRecord(TRestOutputRecord* r) {
+    if (r->fEmpty) return;
+
+    if (fAnalysisTree != nullptr) {
+        fAnalysisTree->SetEventInfo(r->fTree);
+    }
+    FillOutputTrees(r->fTree, r->fEventTree);
+}
+
+///////////////////////////////////////////////
+/// \brief Copy the observables of **remotetree** and the event branches of
+/// **remoteeventtree** to the output trees, and fill them. Switch to a new file
+/// if the file size reaches the limit.
+void TRestProcessRunner::FillOutputTrees(TRestAnalysisTree* remotetree, TTree* remoteeventtree) {
 #ifdef TIME_MEASUREMENT
     high_resolution_clock::time_point t5 = high_resolution_clock::now();
 #endif
-    if (t->GetOutputEvent() != nullptr) {
-        fOutputEvent = t->GetOutputEvent();
-        // copy address of analysis tree of the given thread
-        // to the local tree, then fill the local tree
-        TObjArray* branchesT;
-        TObjArray* branchesL;
-
-        if (fAnalysisTree != nullptr) {
-            TRestAnalysisTree* remotetree = t->GetAnalysisTree();
-
-            // t->GetAnalysisTree()->SetEventInfo(t->GetOutputEvent());
-            // branchesT = t->GetAnalysisTree()->GetListOfBranches();
-            // branchesL = fAnalysisTree->GetListOfBranches();
-            // for (int i = 0; i < nBranches; i++) {
-            //    TBranch* branchT = (TBranch*)branchesT->UncheckedAt(i);
-            //    TBranch* branchL = (TBranch*)branchesL->UncheckedAt(i);
-            //    branchL->SetAddress(branchT->GetAddress());
-            //}
-            fAnalysisTree->SetEventInfo(fOutputEvent);
-            for (int n = 0; n < remotetree->GetNumberOfObservables(); n++) {
-                fAnalysisTree->SetObservable(n, remotetree->GetObservable(n));
+    // copy address of analysis tree of the given thread
+    // to the local tree, then fill the local tree
+    TObjArray* branchesT;
+    TObjArray* branchesL;
+
+    if (fAnalysisTree != nullptr) {
+        for (int n = 0; n < remotetree->GetNumberOfObservables(); n++) {
+            if (n == (int)fOutputObservableIds.size()) {
+                // a new observable, added to the output tree if it passes the filter
+                string name = (string)remotetree->GetObservableName(n);
+                fOutputObservableIds.push_back(
+                    fAnalysisTree->IsObservableActive(name) ? fAnalysisTree->GetNumberOfObservables() : -1);
+            }
+            if (fOutputObservableIds[n] != -1) {
+                fAnalysisTree->SetObservable(fOutputObservableIds[n], remotetree->GetObservable(n));
             }
+        }
 
-            fAnalysisTree->Fill();
+        fAnalysisTree->Fill();
+    }
+
+    if (fEventTree != nullptr) {
+        branchesT = remoteeventtree->GetListOfBranches();
+        branchesL = fEventTree->GetListOfBranches();
+        for (int i = 0; i < branchesT->GetLast() + 1; i++) {
+            TBranch* branchT = (TBranch*)branchesT->UncheckedAt(i);
+            TBranch* branchL = (TBranch*)branchesL->UncheckedAt(i);
+            branchL->SetAddress(branchT->GetAddress());
         }
+        fEventTree->Fill();
+    }
+    fProcessedEvents++;
 
-        if (fEventTree != nullptr) {
-            // t->GetEventTree()->FillEvent(t->GetOutputEvent());
-            branchesT = t->GetEventTree()->GetListOfBranches();
-            branchesL = fEventTree->GetListOfBranches();
-            for (int i = 0; i < branchesT->GetLast() + 1; i++) {
-                TBranch* branchT = (TBranch*)branchesT->UncheckedAt(i);
-                TBranch* branchL = (TBranch*)branchesL->UncheckedAt(i);
-                branchL->SetAddress(branchT->GetAddress());
-            }
-            fEventTree->Fill();
+    // open the next file in advance, so that the switch does not wait for it
+    if (fAsyncRollover && !fNextFileThread.joinable() && fOutputDataFile->GetEND() > fFileSplitSize * 0.9) {
+        PrepareNextOutputFile();
+    }
 
-            // cout << t->GetOutputEvent()->GetID() << endl;
+    // switch file if file size reaches target
+    if (fOutputDataFile->GetEND() > fFileSplitSize) {
+        if (fAnalysisTree->GetDirectory() == (TDirectory*)fOutputDataFile) {
+            SwitchOutputFile();
+        } else {
+            RESTError << "internal error!" << RESTendl;
         }
-        fProcessedEvents++;
-
-        // cout << fTempOutputDataFile << " " << fTempOutputDataFile->GetEND() << " " <<
-        // fAnalysisTree->GetDirectory() << endl; cout << fAutoSplitFileSize << endl; switch file if file size
-        // reaches target
-        if (fOutputDataFile->GetEND() > fFileSplitSize) {
-            if (fAnalysisTree->GetDirectory() == (TDirectory*)fOutputDataFile) {
-                fNFilesSplit++;
-                cout << "TRestProcessRunner: file size reaches limit (" << fFileSplitSize
-                     << " bytes), switching to new file with index " << fNFilesSplit << endl;
-
-                // wait 0.1s for the process to finish
-                usleep(100000);
-                for (auto th : fThreads) {
-                    for (int j = 0; j < fProcessNumber; j++) {
-                        auto proc = th->GetProcess(j);
-                        proc->NotifyAnalysisTreeReset();
-                    }
-                }
+    }
 
-                fAnalysisTree->AutoSave();
-                fAnalysisTree->Reset();
+#ifdef TIME_MEASUREMENT
+    high_resolution_clock::time_point t6 = high_resolution_clock::now();
+    writeTime += (int)duration_cast<microseconds>(t6 - t5).count();
+#endif
 
-                if (fEventTree != nullptr) {
-                    fEventTree->AutoSave();
-                    fEventTree->Reset();
-                }
+    if (fProcStatus == kStep) {
+        fProcStatus = kPause;
+        cout << "Processed events:" << fProcessedEvents << endl;
+    }
+}
 
-                // write some information to the first(main) data file
-                fRunInfo->SetNFilesSplit(fNFilesSplit);
-                if (fOutputDataFile->GetName() != fOutputDataFileName) {
-                    auto Mainfile = std::unique_ptr<TFile>{TFile::Open(fOutputDataFileName, "update")};
-                    WriteMetadata();
-                    Mainfile->Close();
-                } else {
-                    WriteMetadata();
-                }
+///////////////////////////////////////////////
+/// \brief Create the pool of output records used to sort the output events
+/// and to hand them to the writer stage
+///
+/// The records have the same observables and event branches as the trees of
+/// the first thread. Their number is given by `reorderBufferSize`, which
+/// defaults to four times the number of events that the threads can hold, i.e.
+/// the thread number times `dispatchChunkSize`. It cannot be smaller than the
+/// latter. The number of events being processed and not yet written is limited
+/// to this value, so it also bounds the memory used for sorting.
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="threadNumber" value="8"/>
+///     <parameter name="sortOutputEvents" value="ON"/>
+///     <parameter name="reorderBufferSize" value="64"/>
+///     ...
+/// \endcode
+void TRestProcessRunner::CreateOutputRecords() {
+    int chunk = (fUsePipeline || fDispatchChunkSize < 1) ? 1 : fDispatchChunkSize;
+    int size = fReorderBufferSize > 0 ? fReorderBufferSize : 4 * fThreadNumber * chunk;
+    if (size < fThreadNumber * chunk) {
+        RESTWarning << "TRestProcessRunner: reorderBufferSize cannot be smaller than the thread number "
+                       "times dispatchChunkSize!"
+                    << RESTendl;
+        size = fThreadNumber * chunk;
+    }
 
-                TFile* newfile = new TFile(fOutputDataFileName + "." + ToString(fNFilesSplit), "recreate");
+    fReorderBuffer.clear();
+    fFlushing = false;
+
+    fFreeRecords = new TRestBoundedQueue<TRestOutputRecord*>(size);
+    TTree* threadeventtree = fThreads[0]->GetEventTree();
+    for (int i = 0; i < size; i++) {
+        TRestOutputRecord* r = new TRestOutputRecord();
+        r->fTree = new TRestAnalysisTree("AnalysisTree_record" + ToString(i), "dummyTree");
+        r->fTree->SetDirectory(nullptr);
+        r->fTree->DisableQuickObservableValueSetting();
+        if (threadeventtree != nullptr) {
+            r->fEventTree = new TTree((TString) "EventTree_record" + ToString(i), "dummyTree");
+            r->fEventTree->SetDirectory(nullptr);
+            TObjArray* branches = threadeventtree->GetListOfBranches();
+            for (int j = 0; j < branches->GetLast() + 1; j++) {
+                TBranchElement* branch = (TBranchElement*)branches->UncheckedAt(j);
+                TRestEvent* evt = (TRestEvent*)((TRestEvent*)branch->GetObject())->Clone();
+                r->fEvents.push_back(evt);
+                r->fEventTree->Branch(branch->GetName(), evt->ClassName(), evt);
+            }
+        }
+        fOutputRecords.push_back(r);
+        fFreeRecords->Push(r);
+    }
+}
 
-                TBranch* branch = nullptr;
-                fAnalysisTree->SetDirectory(newfile);
-                TIter nextb1(fAnalysisTree->GetListOfBranches());
-                while ((branch = (TBranch*)nextb1())) {
-                    branch->SetFile(newfile);
-                }
-                if (fAnalysisTree->GetBranchRef()) {
-                    fAnalysisTree->GetBranchRef()->SetFile(newfile);
-                }
+///////////////////////////////////////////////
+/// \brief Delete the pool of output records
+///
+void TRestProcessRunner::DeleteOutputRecords() {
+    for (auto r : fOutputRecords) {
+        delete r->fEventTree;
+        for (auto evt : r->fEvents) {
+            delete evt;
+        }
+        delete r->fTree;
+        delete r;
+    }
+    fOutputRecords.clear();
+    fReorderBuffer.clear();
+    delete fFreeRecords;
+    fFreeRecords = nullptr;
+}
 
-                if (fEventTree != nullptr) {
-                    fEventTree->SetDirectory(newfile);
-                    TIter nextb2(fEventTree->GetListOfBranches());
-                    while ((branch = (TBranch*)nextb2())) {
-                        branch->SetFile(newfile);
-                    }
-                    if (fEventTree->GetBranchRef()) {
-                        fEventTree->GetBranchRef()->SetFile(newfile);
-                    }
-                }
+///////////////////////////////////////////////
+/// \brief Copy the output event and the observables of the given thread to
+/// the given record
+///
+/// The thread owns its data, so no lock is needed here.
+void TRestProcessRunner::SaveToRecord(TRestThread* t, TRestOutputRecord* r) {
+    r->fSequence = t->GetSequence();
+    r->fEmpty = t->GetOutputEvent() == nullptr;
+    if (r->fEmpty) return;
+
+    r->fTree->SetEventInfo(t->GetOutputEvent());
+    TRestAnalysisTree* remotetree = t->GetAnalysisTree();
+    for (int n = 0; n < remotetree->GetNumberOfObservables(); n++) {
+        r->fTree->SetObservable(n, remotetree->GetObservable(n));
+    }
 
-                fOutputDataFile->Close();
-                delete fOutputDataFile;
-                fOutputDataFile = newfile;
-            } else {
-                RESTError << "internal error!" << RESTendl;
-            }
+    if (r->fEventTree != nullptr) {
+        TObjArray* branches = t->GetEventTree()->GetListOfBranches();
+        for (int i = 0; i < branches->GetLast() + 1; i++) {
+            TBranchElement* branch = (TBranchElement*)branches->UncheckedAt(i);
+            ((TRestEvent*)branch->GetObject())->CloneTo(r->fEvents[i]);
         }
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Write the parked records which are next in sequence
+///
+/// It must be called holding **lock** on fReorderMutex. The lock is released
+/// while writing. Only one thread flushes at a time, the others just leave
+/// their records in the buffer.
+void TRestProcessRunner::FlushReorderBuffer(std::unique_lock<std::mutex>& lock) {
+    if (fFlushing) return;
+    fFlushing = true;
+    while (true) {
+        auto iter = fReorderBuffer.find(fNextWriteSequence);
+        if (iter == fReorderBuffer.end()) break;
+        TRestOutputRecord* record = iter->second;
+        fReorderBuffer.erase(iter);
+        lock.unlock();
+
+        LockCounted(mutex_write);
+        WriteOutputRecord(record);
+        CheckpointAfter(record->fSequence);
+        mutex_write.unlock();
+        fFreeRecords->Push(record);
+
+        lock.lock();
+        fNextWriteSequence++;
+        fReorderCondition.notify_all();
+    }
+    fFlushing = false;
+}
+
+///////////////////////////////////////////////
+/// \brief Wait before reading **nEvents** new events if too many events are
+/// waiting to be written in order
+///
+/// It limits the sequence numbers given to the new events, such that every
+/// event being processed or parked can have its own output record.
+void TRestProcessRunner::WaitForReorderWindow(int nEvents) {
+    if (!fSortOutputEvents || fOutputRecords.empty()) return;
+    std::unique_lock<std::mutex> lock(fReorderMutex);
+    fReorderCondition.wait(lock, [&] {
+        return fNextSequence + nEvents <= fNextWriteSequence + (Long64_t)fOutputRecords.size();
+    });
+}
+
+///////////////////////////////////////////////
+/// \brief Start the writer thread
+///
+/// The writer thread owns the output file and trees during the process. The
+/// TRestThread workers copy their output event and observables to one of the
+/// output records, and hand it to the writer through a bounded queue. They can
+/// then continue with the next event while the writer compresses and writes
+/// the previous ones. The records are reused, so the number of them (see
+/// CreateOutputRecords()) sets how many events can be buffered.
+///
+/// The file splitting also happens in the writer thread. It is used in
+/// pipeline mode, and can be enabled alone with `asyncOutput`:
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="threadNumber" value="8"/>
+///     <parameter name="asyncOutput" value="ON"/>
+///     ...
+/// \endcode
+void TRestProcessRunner::StartWriter() {
+    fWriteQueue = new TRestBoundedQueue<TRestOutputRecord*>(fOutputRecords.size());
+    fWriterActive = true;
+    fWriterThread = thread(&TRestProcessRunner::WriterLoop, this);
+}
+
+///////////////////////////////////////////////
+/// \brief Stop the writer thread, after writing all the records in the queue
+///
+void TRestProcessRunner::StopWriter() {
+    fWriteQueue->Close();
+    if (fWriterThread.joinable()) fWriterThread.join();
+    fWriterActive = false;
+    delete fWriteQueue;
+    fWriteQueue = nullptr;
+}
+
+///////////////////////////////////////////////
+/// \brief Start the reader stage of the pipeline mode
+///
+/// In pipeline mode (`usePipeline` set to ON) the input file is read by a
+/// dedicated reader thread, which fills a pool of event slots ahead of time.
+/// The number of slots is given by `pipelineDepth`, which defaults to twice
+/// the thread number. The TRestThread workers take ready events from a bounded
+/// lock-free queue, and hand a copy of their output to the writer thread (see
+/// StartWriter()). There is then no global lock shared by reading and writing.
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="threadNumber" value="8"/>
+///     <parameter name="usePipeline" value="ON"/>
+///     <parameter name="pipelineDepth" value="32"/>
+///     ...
+/// \endcode
+void TRestProcessRunner::StartPipeline() {
+    if (fRunInfo->GetInputEvent() == nullptr) {
+        RESTWarning << "TRestProcessRunner: no input event, pipeline mode is disabled" << RESTendl;
+        return;
+    }
+
+    int depth = fPipelineDepth > 0 ? fPipelineDepth : 2 * fThreadNumber;
+    if (depth < fThreadNumber) depth = fThreadNumber;
+
+    RESTInfo << "TRestProcessRunner: starting pipeline with " << depth << " event slots" << RESTendl;
+
+    fFreeSlots = new TRestBoundedQueue<TRestEventSlot*>(depth);
+    fReadySlots = new TRestBoundedQueue<TRestEventSlot*>(depth);
+    fEventSlots.resize(depth);
+    for (int i = 0; i < depth; i++) {
+        fEventSlots[i].fEvent = (TRestEvent*)fRunInfo->GetInputEvent()->Clone();
+        fEventSlots[i].fTree = new TRestAnalysisTree("AnalysisTree_slot" + ToString(i), "dummyTree");
+        fEventSlots[i].fTree->SetDirectory(nullptr);
+        fEventSlots[i].fTree->DisableQuickObservableValueSetting();
+        fFreeSlots->Push(&fEventSlots[i]);
+    }
+
+    fPipelineActive = true;
+    fReaderThread = thread(&TRestProcessRunner::ReaderLoop, this);
+}
+
+///////////////////////////////////////////////
+/// \brief Stop the reader stage after all the TRestThread workers have finished
+///
+void TRestProcessRunner::StopPipeline() {
+    fFreeSlots->Close();
+    fReadySlots->Close();
+    if (fReaderThread.joinable()) fReaderThread.join();
+
+    fPipelineActive = false;
+
+    for (auto& slot : fEventSlots) {
+        delete slot.fEvent;
+        delete slot.fTree;
+    }
+    fEventSlots.clear();
 
+    delete fFreeSlots;
+    delete fReadySlots;
+    fFreeSlots = nullptr;
+    fReadySlots = nullptr;
+}
+
+///////////////////////////////////////////////
+/// \brief Reader stage of the pipeline. It reads events from TRestRun into
+/// free slots and queues them for the workers.
+///
+/// The ready queue is closed at the end of the input, which makes
+/// GetNextevtFunc() return -1 once the remaining events are consumed.
+void TRestProcessRunner::ReaderLoop() {
+    TRestEventSlot* slot = nullptr;
+    while (fFreeSlots->Pop(slot)) {
+        while (fProcStatus == kPause) {
+            usleep(100000);
+        }
+        WaitForReorderWindow(1);
+        // eventsToProcess counts the entries read, see BeginOfInit()
+        if (fNextSequence >= fEventsToProcess || fFirstEntry + fNextSequence >= fLastEntry ||
+            fProcStatus == kStopping) {
+            break;
+        }
 #ifdef TIME_MEASUREMENT
-        high_resolution_clock::time_point t6 = high_resolution_clock::now();
-        writeTime += (int)duration_cast<microseconds>(t6 - t5).count();
+        high_resolution_clock::time_point t1 = high_resolution_clock::now();
 #endif
+        int n = fRunInfo->GetNextEvent(slot->fEvent, fInputAnalysisStorage ? slot->fTree : nullptr);
+#ifdef TIME_MEASUREMENT
+        high_resolution_clock::time_point t2 = high_resolution_clock::now();
+        readTime += (int)duration_cast<microseconds>(t2 - t1).count();
+#endif
+        if (n != 0) {
+            break;
+        }
+        slot->fSequence = fNextSequence++;
+        if (!fReadySlots->Push(slot)) {
+            break;
+        }
+    }
+    fReadySlots->Close();
+}
 
-        if (fProcStatus == kStep) {
-            fProcStatus = kPause;
-            cout << "Processed events:" << fProcessedEvents << endl;
+///////////////////////////////////////////////
+/// \brief Main loop of the writer thread. It writes the records handed over by
+/// FillThreadEventFunc(), in the order of the input if `sortOutputEvents` is ON.
+void TRestProcessRunner::WriterLoop() {
+    TRestOutputRecord* record = nullptr;
+    while (fWriteQueue->Pop(record)) {
+        if (!fSortOutputEvents) {
+            mutex_write.lock();
+            WriteOutputRecord(record);
+            mutex_write.unlock();
+            fFreeRecords->Push(record);
+            continue;
         }
+        std::unique_lock<std::mutex> lock(fReorderMutex);
+        fReorderBuffer[record->fSequence] = record;
+        FlushReorderBuffer(lock);
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Set the observables saved in the output on the given tree
+///
+/// By default all the observables of the chain are saved. A skim of the
+/// output can be given as lists of names, separated by ":", which may contain
+/// the wildcards `*` and `?`:
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="keepObservables" value="sAna_*:hitsAna_energy"/>
+///     <parameter name="dropObservables" value="sAna_*Time*"/>
+///     <parameter name="dropEventBranches" value="TRestRawSignalEventBranch"/>
+///     ...
+/// \endcode
+///
+/// An observable is saved if it matches `keepObservables`, or it is empty, and
+/// it does not match `dropObservables`. The same holds for the event branches
+/// of the EventTree, with `keepEventBranches` and `dropEventBranches`, see
+/// IsEventBranchKept(). The observables which are not saved are still set in
+/// the trees of the threads, for the processes which read them, unless the
+/// process skips them, see TRestEventProcess::IsObservableActive().
+void TRestProcessRunner::SetObservableFilter(TRestAnalysisTree* tree) const {
+    tree->SetObservableFilter(Split(fKeepObservables, ":", false, true),
+                             Split(fDropObservables, ":", false, true));
+}
+
+///////////////////////////////////////////////
+/// \brief Returns whether the given branch of the EventTree is saved, according
+/// to `keepEventBranches` and `dropEventBranches`
+Bool_t TRestProcessRunner::IsEventBranchKept(const string& branchName) const {
+    vector<string> keep = Split(fKeepEventBranches, ":", false, true);
+    bool kept = keep.empty();
+    for (const auto& pattern : keep) {
+        if (MatchString(branchName, pattern)) kept = true;
+    }
+    for (const auto& pattern : Split(fDropEventBranches, ":", false, true)) {
+        if (MatchString(branchName, pattern)) kept = false;
+    }
+    return kept;
+}
+
+///////////////////////////////////////////////
+/// \brief Returns true if the output file may reach `fileSplitSize`
+///
+/// The size of the output is not known in advance. It is taken to be at most
+/// four times the size of the input file, and is unknown for the data decoded
+/// by an external file process. If the output is split anyway, the split files
+/// are just opened and closed by the thread writing the output.
+Bool_t TRestProcessRunner::CanSplitOutput() {
+    if (fRunInfo->GetFileProcess() != nullptr) return true;
+    Long64_t inputBytes = fRunInfo->GetTotalBytes();
+    return inputBytes <= 0 || 4 * inputBytes > fFileSplitSize;
+}
+
+///////////////////////////////////////////////
+/// \brief Open the next split file, on a helper thread if fAsyncRollover
+///
+/// It is called when the output file is close to `fileSplitSize`. The new file
+/// gets the compression settings of the current one.
+void TRestProcessRunner::PrepareNextOutputFile() {
+    TString fileName = fOutputDataFileName + "." + ToString(fNFilesSplit + 1);
+    Int_t settings = fOutputDataFile->GetCompressionSettings();
+    auto open = [this, fileName, settings]() {
+        TDirectory::TContext context;
+        TFile* file = new TFile(fileName, "recreate");
+        file->SetCompressionSettings(settings);
+        fNextOutputFile = file;
+    };
+    if (fAsyncRollover) {
+        fNextFileThread = std::thread(open);
+    } else {
+        open();
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Continue the output trees in the next split file
+///
+/// It is called by FillOutputTrees(), holding mutex_write, when the output file
+/// reaches `fileSplitSize`. Only the work on the objects shared with the
+/// threads is done here: the baskets still in memory are written to the file
+/// being left, the trees are moved to the next file, which is already open, see
+/// PrepareNextOutputFile(), and the run and the processes are streamed into
+/// memory. The rest is done in the background by CloseSplitFile(): the event
+/// index is saved with the analysis tree of the file left, the metadata is
+/// written to the main file and the file is closed. The threads are therefore
+/// not stopped while the files are opened, read back or closed.
+void TRestProcessRunner::SwitchOutputFile() {
+    // the main file is updated by the previous CloseSplitFile(), it may be still running
+    if (fCloseFileThread.joinable()) fCloseFileThread.join();
+    if (!fNextFileThread.joinable() && fNextOutputFile == nullptr) PrepareNextOutputFile();
+    if (fNextFileThread.joinable()) fNextFileThread.join();
+    TFile* newfile = fNextOutputFile;
+    fNextOutputFile = nullptr;
+
+    fNFilesSplit++;
+    cout << "TRestProcessRunner: file size reaches limit (" << fFileSplitSize
+         << " bytes), switching to new file with index " << fNFilesSplit << endl;
+
+    for (auto th : fThreads) {
+        for (int j = 0; j < fProcessNumber; j++) {
+            auto proc = th->GetProcess(j);
+            proc->NotifyAnalysisTreeReset();
+        }
+    }
+
+    // the event index of the file is built by CloseSplitFile(), from the saved tree
+    fAnalysisTree->AutoSave();
+    fAnalysisTree->Reset();
+
+    if (fEventTree != nullptr) {
+        fEventTree->AutoSave();
+        fEventTree->Reset();
+    }
+
+    TBranch* branch = nullptr;
+    fAnalysisTree->SetDirectory(newfile);
+    TIter nextb1(fAnalysisTree->GetListOfBranches());
+    while ((branch = (TBranch*)nextb1())) {
+        branch->SetFile(newfile);
+    }
+    if (fAnalysisTree->GetBranchRef()) {
+        fAnalysisTree->GetBranchRef()->SetFile(newfile);
+    }
+
+    if (fEventTree != nullptr) {
+        fEventTree->SetDirectory(newfile);
+        TIter nextb2(fEventTree->GetListOfBranches());
+        while ((branch = (TBranch*)nextb2())) {
+            branch->SetFile(newfile);
+        }
+        if (fEventTree->GetBranchRef()) {
+            fEventTree->GetBranchRef()->SetFile(newfile);
+        }
+    }
+
+    // the run and the processes are used by the threads, they are streamed here, and the
+    // copy is written to the first(main) data file by CloseSplitFile()
+    TMemFile* metadata = nullptr;
+    {
+        TDirectory::TContext context;
+        metadata = new TMemFile(("SplitMetadata_" + ToString(fNFilesSplit)).c_str(), "recreate", "", 0);
+        metadata->cd();
+        WriteMetadata();
+    }
+
+    if (fAsyncRollover) {
+        fCloseFileThread = std::thread(&TRestProcessRunner::CloseSplitFile, this, fOutputDataFile, metadata);
+    } else {
+        CloseSplitFile(fOutputDataFile, metadata);
+    }
+    fOutputDataFile = newfile;
+
+    // the previous file is complete, the checkpoint must point to the new one
+    fCheckpointPending = true;
+}
+
+///////////////////////////////////////////////
+/// \brief Complete and close a split file left by SwitchOutputFile()
+///
+/// It runs on a helper thread if fAsyncRollover. No other thread uses the
+/// file. The analysis tree is read back to save its event index, for
+/// TRestRun::GetEventWithID(), and the objects of **metadata** are copied to
+/// the main file, which is the closed file itself for the first split.
+void TRestProcessRunner::CloseSplitFile(TFile* file, TMemFile* metadata) {
+    TDirectory::TContext context;
+    auto tree = (TRestAnalysisTree*)file->Get("AnalysisTree");
+    if (tree != nullptr) {
+        tree->BuildEventIndex();
+        tree->Write(nullptr, kOverwrite);
+        delete tree;
+    }
+
+    std::unique_ptr<TFile> mainFile;
+    TDirectory* directory = file;
+    if (file->GetName() != fOutputDataFileName) {
+        mainFile.reset(TFile::Open(fOutputDataFileName, "update"));
+        directory = mainFile.get();
+    }
+    TIter nextKey(metadata->GetListOfKeys());
+    TKey* key = nullptr;
+    while ((key = (TKey*)nextKey())) {
+        TObject* object = key->ReadObj();
+        directory->WriteTObject(object, key->GetName(), "WriteDelete");
+        delete object;
+    }
+    delete metadata;
+    if (mainFile) mainFile->Close();
+
+    file->Close();
+    delete file;
+}
+
+///////////////////////////////////////////////
+/// \brief Wait for the split files being opened or closed in the background
+///
+/// A file opened in advance but not used is removed.
+void TRestProcessRunner::StopRollover() {
+    if (fCloseFileThread.joinable()) fCloseFileThread.join();
+    if (fNextFileThread.joinable()) fNextFileThread.join();
+    if (fNextOutputFile != nullptr) {
+        TString fileName = fNextOutputFile->GetName();
+        fNextOutputFile->Close();
+        delete fNextOutputFile;
+        fNextOutputFile = nullptr;
+        remove(fileName.Data());
     }
-    mutex_write.unlock();
 }
 
 ///////////////////////////////////////////////
@@ -944,7 +1989,11 @@ void TRestProcessRunner::ConfigOutputFile() {
     // write tree
     fOutputDataFile->cd();
     if (fEventTree != nullptr) fEventTree->Write(nullptr, kOverwrite);
-    if (fAnalysisTree != nullptr) fAnalysisTree->Write(nullptr, kOverwrite);
+    if (fAnalysisTree != nullptr) {
+        // saved with the tree for TRestRun::GetEventWithID()
+        fAnalysisTree->BuildEventIndex();
+        fAnalysisTree->Write(nullptr, kOverwrite);
+    }
 
     // go back to the first file
     if (fOutputDataFile->GetName() != fOutputDataFileName) {
@@ -968,6 +2017,8 @@ void TRestProcessRunner::WriteMetadata() {
         // sprintf(tmpString, "Process-%d. %s", i + 1, fThreads[0]->GetProcess(i)->GetName());
         fThreads[0]->GetProcess(i)->Write(nullptr, kOverwrite);
     }
+    // the profile is filled at the end of the run
+    if (fProfile.GetNumberOfProcesses() > 0) fProfile.Write(nullptr, kOverwrite);
 }
 
 ///////////////////////////////////////////////
@@ -975,6 +2026,10 @@ void TRestProcessRunner::WriteMetadata() {
 ///
 /// It first saves process metadata in to the main output file, then calls
 /// TRestRun::FormOutputFile() to merge the main file with process's tmp file.
+///
+/// If the threads keep their files in memory (`threadFilesInMemory`, ON by
+/// default), the objects are merged from memory into the main file, without
+/// writing temporary files.
 void TRestProcessRunner::MergeOutputFile() {
     RESTEssential << "Merging thread files together" << RESTendl;
     // add threads file
@@ -982,14 +2037,374 @@ void TRestProcessRunner::MergeOutputFile() {
     // file these files are mush smaller that data file, so they are merged to the
     // data file.
     vector<string> files_to_merge;
+    vector<TFile*> memfiles_to_merge;
     for (int i = 0; i < fThreadNumber; i++) {
         TFile* f = fThreads[i]->GetOutputFile();
-        if (f != nullptr) f->Close();
-        files_to_merge.push_back(f->GetName());
+        if (f == nullptr) continue;
+        if (f->InheritsFrom(TMemFile::Class())) {
+            memfiles_to_merge.push_back(f);
+        } else {
+            f->Close();
+            files_to_merge.push_back(f->GetName());
+        }
     }
 
     fOutputDataFile->Close();
-    fRunInfo->MergeToOutputFile(files_to_merge, fOutputDataFile->GetName());
+    fRunInfo->MergeToOutputFile(files_to_merge, fOutputDataFile->GetName(), memfiles_to_merge);
+
+    // release the memory of the thread files
+    for (auto f : memfiles_to_merge) {
+        f->Close();
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Restrict the entries to process to the given shard of the input
+///
+/// With `shard="i/N"` the entries between firstEntry and lastEntry are split in
+/// N consecutive parts of (almost) the same size, and only the part i (from 0
+/// to N-1) is processed. Each part can then run in an independent job, e.g. on
+/// a different machine:
+///
+/// \code
+/// restManager --c processing.rml --f run.root --s 3/8
+/// \endcode
+///
+/// where `--s` is a shortcut to the parameter `shard` of the runner. The
+/// parts do not overlap and do not depend on the number of threads. The end of
+/// the part is a hard limit: the events cut by the processes do not make the
+/// shard read the entries of the next one. The output
+/// file name gets the suffix "_shard3of8". The outputs of all the shards are
+/// merged back with MergeShards() (or the macro `restMergeShards`) into the file
+/// a single job would have produced, as long as `sortOutputEvents` is ON.
+///
+/// Sharding needs a REST input file, with a known number of entries.
+void TRestProcessRunner::ApplyShard(Long64_t lastEntry) {
+    Int_t index, nShards;
+    if (!GetShardIndex(index, nShards)) {
+        RESTError << "invalid shard \"" << fShard << "\", it must be \"i/N\" with 0 <= i < N" << RESTendl;
+        exit(1);
+    }
+    if (fRunInfo->GetFileProcess() != nullptr || fRunInfo->GetEntries() == REST_MAXIMUM_EVENTS) {
+        RESTError << "sharding needs an input file with a known number of entries" << RESTendl;
+        exit(1);
+    }
+
+    Long64_t last = min(lastEntry, fRunInfo->GetEntries());
+    Long64_t total = max(last - fFirstEntry, (Long64_t)0);
+    Long64_t begin = fFirstEntry + total * index / nShards;
+    Long64_t end = fFirstEntry + total * (index + 1) / nShards;
+    fFirstEntry = begin;
+    fLastEntry = end;
+    fEventsToProcess = end - begin;
+    RESTInfo << "Shard " << index << " of " << nShards << " : processing entries " << begin << " to "
+             << end - 1 << RESTendl;
+    if (fEventsToProcess == 0) {
+        RESTWarning << "Shard " << fShard << " is empty, there are not enough entries" << RESTendl;
+    }
+
+    string outputFileName = (string)fRunInfo->GetOutputFileName();
+    if (outputFileName != "/dev/null") {
+        string suffix = "_shard" + ToString(index) + "of" + ToString(nShards);
+        string extension = TRestTools::GetFileNameExtension(outputFileName);
+        if (extension != "") {
+            outputFileName = outputFileName.substr(0, outputFileName.size() - extension.size() - 1) +
+                             suffix + "." + extension;
+        } else {
+            outputFileName += suffix;
+        }
+        fRunInfo->SetOutputFileName(outputFileName);
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Get the shard index and the number of shards. Returns false if the
+/// shard is not set or is not valid.
+///
+Bool_t TRestProcessRunner::GetShardIndex(Int_t& index, Int_t& nShards) const {
+    vector<string> items = Split(fShard, "/");
+    if (items.size() != 2 || !isANumber(items[0]) || !isANumber(items[1])) return false;
+    index = StringToInteger(items[0]);
+    nShards = StringToInteger(items[1]);
+    return nShards >= 1 && index >= 0 && index < nShards;
+}
+
+///////////////////////////////////////////////
+/// \brief Merge the output files of all the shards of a run into **outputFileName**
+///
+/// The files are ordered by their shard index, so the AnalysisTree and the
+/// EventTree get the events in the same order as a single job. The split files
+/// of each shard follow its main file. The process
+/// outputs, e.g. histograms, are merged by TFileMerger. The metadata objects
+/// are taken from the first shard, with the run end time, the number of entries
+/// and the entry range of the runner updated to the whole run.
+///
+/// All the shards of the run must be given. Returns 0 on success.
+Int_t TRestProcessRunner::MergeShards(vector<string> files, string outputFileName) {
+    map<Int_t, vector<string>> shardFiles;
+    Int_t nShards = -1;
+    Int_t eventsProcessed = 0;
+    Double_t endTime = 0;
+    for (const auto& fileName : files) {
+        TFile* f = TFile::Open(fileName.c_str());
+        if (f == nullptr || f->IsZombie()) {
+            RESTError << "MergeShards: cannot open file " << fileName << RESTendl;
+            return 1;
+        }
+        TRestProcessRunner* runner = nullptr;
+        TRestRun* run = nullptr;
+        TIter nextkey(f->GetListOfKeys());
+        while (TKey* key = (TKey*)nextkey()) {
+            // only the last cycle of each object
+            if (key->GetCycle() != f->GetKey(key->GetName())->GetCycle()) continue;
+            TClass* c = TClass::GetClass(key->GetClassName());
+            if (c == nullptr) continue;
+            if (runner == nullptr && c->InheritsFrom(TRestProcessRunner::Class())) {
+                runner = (TRestProcessRunner*)key->ReadObj();
+            } else if (run == nullptr && c->InheritsFrom(TRestRun::Class())) {
+                run = (TRestRun*)key->ReadObj();
+            }
+        }
+
+        Int_t index = -1, n = -1;
+        Int_t events = 0;
+        Int_t nFilesSplit = 0;
+        if (runner != nullptr && runner->GetShardIndex(index, n)) events = runner->fEventsToProcess;
+        if (run != nullptr) {
+            endTime = max(endTime, run->GetEndTimestamp());
+            nFilesSplit = run->GetNFilesSplit();
+        }
+        delete runner;
+        delete run;
+        f->Close();
+        delete f;
+
+        if (index == -1) {
+            RESTError << "MergeShards: file " << fileName << " is not the output of a shard" << RESTendl;
+            return 1;
+        }
+        if (nShards != -1 && n != nShards) {
+            RESTError << "MergeShards: file " << fileName << " belongs to a run with " << n
+                      << " shards, not " << nShards << RESTendl;
+            return 1;
+        }
+        if (shardFiles.count(index)) {
+            RESTError << "MergeShards: shard " << index << " is given twice" << RESTendl;
+            return 1;
+        }
+        nShards = n;
+        shardFiles[index].push_back(fileName);
+        for (int i = 1; i <= nFilesSplit; i++) {
+            string splitFileName = fileName + "." + ToString(i);
+            if (!TRestTools::fileExists(splitFileName)) {
+                RESTError << "MergeShards: split file " << splitFileName << " is missing" << RESTendl;
+                return 1;
+            }
+            shardFiles[index].push_back(splitFileName);
+        }
+        eventsProcessed += events;
+    }
+    if (nShards == -1 || (Int_t)shardFiles.size() != nShards) {
+        RESTError << "MergeShards: " << shardFiles.size() << " shards given, " << nShards << " expected"
+                  << RESTendl;
+        return 1;
+    }
+
+    TFileMerger merger(false);
+    merger.OutputFile(outputFileName.c_str(), "RECREATE");
+    for (const auto& shard : shardFiles) {
+        for (const auto& fileName : shard.second) merger.AddFile(fileName.c_str(), false);
+    }
+    if (!merger.Merge()) {
+        RESTError << "MergeShards: failed to merge the shard files" << RESTendl;
+        return 1;
+    }
+
+    // replace the metadata objects by the ones of the first shard, updated to the whole run
+    TFile* first = TFile::Open(shardFiles.begin()->second[0].c_str());
+    TFile* output = TFile::Open(outputFileName.c_str(), "UPDATE");
+    TTree* tree = (TTree*)output->Get("AnalysisTree");
+    TIter nextkey(first->GetListOfKeys());
+    while (TKey* key = (TKey*)nextkey()) {
+        // an older cycle must not overwrite the last one
+        if (key->GetCycle() != first->GetKey(key->GetName())->GetCycle()) continue;
+        TClass* c = TClass::GetClass(key->GetClassName());
+        if (c == nullptr || !c->InheritsFrom(TRestMetadata::Class())) continue;
+        TRestMetadata* md = (TRestMetadata*)key->ReadObj();
+        if (md->InheritsFrom(TRestProcessRunner::Class())) {
+            TRestProcessRunner* runner = (TRestProcessRunner*)md;
+            runner->fShard = "";
+            runner->fEventsToProcess = eventsProcessed;
+        } else if (md->InheritsFrom(TRestRun::Class())) {
+            TRestRun* run = (TRestRun*)md;
+            run->SetEndTimeStamp(endTime);
+            run->SetOutputFileName(outputFileName);
+            run->SetNFilesSplit(0);
+            if (tree != nullptr) run->SetEntriesSaved(tree->GetEntries());
+        }
+        output->cd();
+        output->Delete(((string)key->GetName() + ";*").c_str());
+        md->Write(key->GetName());
+        delete md;
+    }
+    output->Close();
+    first->Close();
+    delete output;
+    delete first;
+
+    RESTInfo << "MergeShards: " << nShards << " shards merged into " << outputFileName << RESTendl;
+    return 0;
+}
+
+///////////////////////////////////////////////
+/// \brief Take a checkpoint, if needed, after the event with sequence number
+/// **seq** has been written in order.
+///
+/// It must be called holding mutex_write.
+void TRestProcessRunner::CheckpointAfter(Long64_t seq) {
+    if (fCheckpointInterval <= 0) return;
+    if (!fCheckpointPending && (seq + 1) % fCheckpointInterval != 0) return;
+    WriteCheckpoint(seq + 1);
+}
+
+///////////////////////////////////////////////
+/// \brief Save the output trees, and record how far the output is complete.
+///
+/// Long runs can be protected against crashes with periodic checkpoints:
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="threadNumber" value="16"/>
+///     <parameter name="checkpointInterval" value="10000"/>
+///     <parameter name="resume" value="ON"/>
+///     ...
+/// \endcode
+///
+/// Every `checkpointInterval` entries, and after each file split, the output
+/// trees are saved to disk with TTree::AutoSave(). A small text file next to
+/// the output file (OUTPUT.root.checkpoint) then records the number of entries
+/// committed, i.e. whose outputs are all written in order, the split files
+/// already completed and the number of tree entries in the current file.
+///
+/// If the job dies, running it again with `resume` ON continues from the last
+/// checkpoint, see ResumeFromCheckpoint(). The checkpoint file is removed when
+/// the job finishes. Checkpoints need `sortOutputEvents` ON and a REST input
+/// file.
+void TRestProcessRunner::WriteCheckpoint(Long64_t committedEntries) {
+    fCheckpointPending = false;
+    // the split files listed must be complete on disk
+    if (fCloseFileThread.joinable()) fCloseFileThread.join();
+    if (fAnalysisTree != nullptr) fAnalysisTree->AutoSave("SaveSelf");
+    if (fEventTree != nullptr) fEventTree->AutoSave("SaveSelf");
+
+    // write a new file and rename it, so that a crash never leaves a partial checkpoint
+    string fileName = GetCheckpointFileName();
+    ofstream file(fileName + ".tmp");
+    file << "firstEntry " << fFirstEntry << endl;
+    file << "eventsToProcess " << fEventsToProcess << endl;
+    file << "committedEntries " << committedEntries << endl;
+    file << "processedEvents " << fProcessedEvents << endl;
+    file << "filesSplit " << fNFilesSplit << endl;
+    file << "analysisTreeEntries " << (fAnalysisTree != nullptr ? fAnalysisTree->GetEntries() : 0) << endl;
+    file << "eventTreeEntries " << (fEventTree != nullptr ? fEventTree->GetEntries() : 0) << endl;
+    file.close();
+    rename((fileName + ".tmp").c_str(), fileName.c_str());
+}
+
+///////////////////////////////////////////////
+/// \brief Continue the job of the same output file from its last checkpoint
+///
+/// The files already written are kept. The trees of the file being written at
+/// the checkpoint are cut back to the checkpoint, as they may hold some more
+/// entries saved by ROOT before the crash, and later split files are removed.
+/// The resumed job then starts at the first entry not committed, writing to a
+/// new split file, as if the output had been split at the checkpoint.
+///
+/// The state of the processes is not part of the checkpoint. A job with a
+/// process working at the end of the run, in EndProcess(), e.g. writing
+/// histograms of all the events, cannot be resumed.
+///
+/// Returns false if there is no valid checkpoint, or the job cannot be resumed,
+/// so that it starts from the beginning.
+Bool_t TRestProcessRunner::ResumeFromCheckpoint() {
+    for (int i = 0; i < fProcessNumber; i++) {
+        TRestEventProcess* process = fThreads[0]->GetProcess(i);
+        TMethod* method = process->IsA()->GetMethodAllAny("EndProcess");
+        if (method != nullptr && method->GetClass() != TRestEventProcess::Class()) {
+            RESTWarning << process->ClassName() << " writes its output at the end of the run, the job "
+                        << "cannot be resumed and starts from the beginning" << RESTendl;
+            return false;
+        }
+    }
+
+    string fileName = GetCheckpointFileName();
+    if (!TRestTools::fileExists(fileName)) {
+        RESTInfo << "No checkpoint found for " << fOutputDataFileName << ", starting from the beginning"
+                 << RESTendl;
+        return false;
+    }
+
+    map<string, Long64_t> checkpoint;
+    ifstream file(fileName);
+    string key;
+    Long64_t value;
+    while (file >> key >> value) checkpoint[key] = value;
+
+    if (checkpoint["firstEntry"] != fFirstEntry || checkpoint["eventsToProcess"] != fEventsToProcess) {
+        RESTWarning << "Checkpoint " << fileName << " belongs to a different entry range, it is ignored"
+                    << RESTendl;
+        return false;
+    }
+
+    Int_t nFilesSplit = checkpoint["filesSplit"];
+    TString currentFileName =
+        nFilesSplit == 0 ? fOutputDataFileName : fOutputDataFileName + "." + ToString(nFilesSplit);
+    TFile* current = TFile::Open(currentFileName, "update");
+    if (current == nullptr || current->IsZombie() ||
+        !TruncateTree(current, "AnalysisTree", checkpoint["analysisTreeEntries"]) ||
+        !TruncateTree(current, "EventTree", checkpoint["eventTreeEntries"])) {
+        RESTError << "Output file " << currentFileName << " does not match the checkpoint, cannot resume"
+                  << RESTendl;
+        exit(1);
+    }
+    current->Close();
+    delete current;
+
+    for (int i = nFilesSplit + 1;; i++) {
+        string stale = (string)fOutputDataFileName + "." + ToString(i);
+        if (!TRestTools::fileExists(stale)) break;
+        remove(stale.c_str());
+    }
+
+    fResumedEntries = checkpoint["committedEntries"];
+    fResumedEvents = checkpoint["processedEvents"];
+    fNFilesSplit = nFilesSplit + 1;
+    fRunInfo->SetNFilesSplit(fNFilesSplit);
+    fOutputDataFile = new TFile(fOutputDataFileName + "." + ToString(fNFilesSplit), "recreate");
+
+    RESTEssential << "Resuming from checkpoint: " << fResumedEntries << " entries already processed"
+                  << RESTendl;
+    return true;
+}
+
+///////////////////////////////////////////////
+/// \brief Cut back the tree **treeName** of the given file to its first **entries** entries
+///
+/// Returns false if the tree has fewer entries.
+Bool_t TRestProcessRunner::TruncateTree(TFile* file, string treeName, Long64_t entries) {
+    TTree* tree = (TTree*)file->Get(treeName.c_str());
+    if (tree == nullptr) return entries == 0;
+    if (tree->GetEntries() < entries) return false;
+    if (tree->GetEntries() > entries) {
+        TTree* copy = tree->CloneTree(entries);
+        // Delete() removes all the objects of that name, the ones in memory included
+        copy->SetDirectory(nullptr);
+        file->Delete((treeName + ";*").c_str());
+        copy->SetDirectory(file);
+        copy->Write(treeName.c_str());
+        delete copy;
+    }
+    return true;
 }
 
 // tools
@@ -1025,6 +2440,101 @@ TRestEventProcess* TRestProcessRunner::InstantiateProcess(TString type, TiXmlEle
     return pc;
 }
 
+///////////////////////////////////////////////
+/// \brief Instantiate a copy of an already configured process
+///
+/// The copy takes the expanded rml section of **prototype**, so variables,
+/// expressions, for loops and includes are not processed again. Only
+/// InitFromConfigFile() is called, which sets up the transient members of the
+/// process for its own thread.
+TRestEventProcess* TRestProcessRunner::CloneProcess(TRestEventProcess* prototype) {
+    TRestEventProcess* pc = REST_Reflection::Assembly(prototype->ClassName());
+    if (pc == nullptr) return nullptr;
+
+    pc->SetConfigFile(fConfigFileName);
+    pc->SetRunInfo(this->fRunInfo);
+    pc->SetHostmgr(fHostmgr);
+    pc->SetObservableValidation(fValidateObservables);
+    if (pc->LoadConfigFromMetadata(prototype) != 0) {
+        delete pc;
+        return nullptr;
+    }
+
+    return pc;
+}
+
+///////////////////////////////////////////////
+/// \brief Returns the ROOT compression settings given by "ALG:level", or -1 if
+/// it is not valid
+///
+/// The algorithm is one of ZLIB, LZMA, LZ4, ZSTD or default (the one of ROOT),
+/// and the level goes from 0 (no compression) to 9. Without level, the default
+/// level of the algorithm is used. A single number is the level of the default
+/// algorithm, as `fileCompression`. An empty string gives **defaultLevel**.
+///
+/// The output trees and the files of the threads can be compressed differently:
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="analysisTreeCompression" value="LZ4:4"/>
+///     <parameter name="eventTreeCompression" value="ZSTD:7"/>
+///     <parameter name="threadFileCompression" value="LZ4:1"/>
+///     ...
+/// \endcode
+///
+/// The settings used are saved with the metadata of TRestProcessRunner.
+Int_t TRestProcessRunner::GetCompressionSettings(const string& compression, Int_t defaultLevel) {
+    using ROOT::RCompressionSetting::EAlgorithm;
+    using ROOT::RCompressionSetting::ELevel;
+    if (compression == "") return defaultLevel;
+
+    vector<string> fields = Split(compression, ":");
+    if (fields.size() == 1 && isANumber(fields[0])) {
+        Int_t level = StringToInteger(fields[0]);
+        return level >= 0 && level <= 9 ? level : -1;
+    }
+    if (fields.empty() || fields.size() > 2) return -1;
+
+    string algorithmName = ToUpper(fields[0]);
+    EAlgorithm::EValues algorithm;
+    Int_t level;
+    if (algorithmName == "DEFAULT") {
+        algorithm = EAlgorithm::kUseGlobal;
+        level = defaultLevel;
+    } else if (algorithmName == "ZLIB") {
+        algorithm = EAlgorithm::kZLIB;
+        level = ELevel::kDefaultZLIB;
+    } else if (algorithmName == "LZMA") {
+        algorithm = EAlgorithm::kLZMA;
+        level = ELevel::kDefaultLZMA;
+    } else if (algorithmName == "LZ4") {
+        algorithm = EAlgorithm::kLZ4;
+        level = ELevel::kDefaultLZ4;
+    } else if (algorithmName == "ZSTD") {
+        algorithm = EAlgorithm::kZSTD;
+        level = ELevel::kDefaultZSTD;
+    } else {
+        return -1;
+    }
+    if (fields.size() == 2) {
+        if (!isANumber(fields[1])) return -1;
+        level = StringToInteger(fields[1]);
+    }
+    if (level < 0 || level > 9) return -1;
+    return ROOT::CompressionSettings(algorithm, level);
+}
+
+///////////////////////////////////////////////
+/// \brief Returns the "ALG:level" form of the given ROOT compression settings
+///
+string TRestProcessRunner::GetCompressionName(Int_t settings) {
+    const map<Int_t, string> algorithms = {{0, "default"}, {1, "ZLIB"}, {2, "LZMA"},
+                                           {3, "OLD"},     {4, "LZ4"},  {5, "ZSTD"}};
+    Int_t algorithm = settings / 100;
+    string name = algorithms.count(algorithm) ? algorithms.at(algorithm) : ToString(algorithm);
+    return name + ":" + ToString(settings % 100);
+}
+
 double TRestProcessRunner::GetReadingSpeed() {
     Long64_t bytes = 0;
     for (auto& n : bytesAdded) bytes += n;
@@ -1060,7 +2570,7 @@ void TRestProcessRunner::PrintProcessedEvents(Int_t rateE) {
         } else if (fRunInfo->GetFileProcess() != nullptr)
         // Nevents is known, reading external data file
         {
-            prog = fProcessedEvents / (double)fEventsToProcess * 100;
+            prog = fNextSequence / (double)fEventsToProcess * 100;
         } else if (fEventsToProcess == REST_MAXIMUM_EVENTS)
         // Nevents is unknown, reading root file
         {
@@ -1068,7 +2578,7 @@ void TRestProcessRunner::PrintProcessedEvents(Int_t rateE) {
         }
 
         else {
-            prog = fProcessedEvents / (double)fEventsToProcess * 100;
+            prog = fNextSequence / (double)fEventsToProcess * 100;
         }
 
         char* buffer = new char[500]();
@@ -1161,10 +2671,43 @@ void TRestProcessRunner::PrintMetadata() {
     RESTMetadata << "Status : " << status << RESTendl;
     RESTMetadata << "Processesed events : " << fProcessedEvents << RESTendl;
     RESTMetadata << "Analysis tree branches : " << fNBranches << RESTendl;
-    RESTMetadata << "Thread number : " << fThreadNumber << RESTendl;
+    if (fAutoThreadNumber) {
+        RESTMetadata << "Thread number : auto (" << fActiveThreads << " of " << fThreadNumber << " active)"
+                     << RESTendl;
+    } else {
+        RESTMetadata << "Thread number : " << fThreadNumber << RESTendl;
+    }
+    RESTMetadata << "Thread affinity : " << fThreadAffinity << RESTendl;
+    if (fShard != "") {
+        RESTMetadata << "Shard : " << fShard << RESTendl;
+    }
+    if (fCheckpointInterval > 0) {
+        RESTMetadata << "Checkpoint interval : " << fCheckpointInterval << RESTendl;
+    }
+    RESTMetadata << "Thread files in memory : " << (fThreadFilesInMemory ? "ON" : "OFF") << RESTendl;
+    RESTMetadata << "Pipeline mode : " << (fUsePipeline ? "ON" : "OFF") << RESTendl;
+    RESTMetadata << "Asynchronous output : " << (fAsyncOutput ? "ON" : "OFF") << RESTendl;
+    RESTMetadata << "Sort output events : " << (fSortOutputEvents ? "ON" : "OFF") << RESTendl;
+    if (fDispatchChunkSize > 1) {
+        RESTMetadata << "Dispatch chunk size : " << fDispatchChunkSize << RESTendl;
+    }
+    if (fReorderBufferSize > 0) {
+        RESTMetadata << "Reorder buffer size : " << fReorderBufferSize << RESTendl;
+    }
     RESTMetadata << "Processes in each thread : " << fProcessNumber << RESTendl;
     RESTMetadata << "File auto split size: " << fFileSplitSize << RESTendl;
     RESTMetadata << "File compression level: " << fFileCompression << RESTendl;
+    RESTMetadata << "EventTree compression: " << fEventTreeCompression << RESTendl;
+    RESTMetadata << "AnalysisTree compression: " << fAnalysisTreeCompression << RESTendl;
+    RESTMetadata << "Thread file compression: " << fThreadFileCompression << RESTendl;
+    if (fKeepObservables != "" || fDropObservables != "") {
+        RESTMetadata << "Observables kept: " << (fKeepObservables == "" ? "all" : fKeepObservables)
+                     << ", dropped: " << fDropObservables << RESTendl;
+    }
+    if (fKeepEventBranches != "" || fDropEventBranches != "") {
+        RESTMetadata << "Event branches kept: " << (fKeepEventBranches == "" ? "all" : fKeepEventBranches)
+                     << ", dropped: " << fDropEventBranches << RESTendl;
+    }
     // cout << "Input filename : " << fInputFilename << endl;
     // cout << "Output filename : " << fOutputFilename << endl;
     // cout << "Number of initial events : " << GetNumberOfEvents() << endl;
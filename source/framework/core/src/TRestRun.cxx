@@ -36,6 +36,8 @@
 #include <unistd.h>
 #endif  // !WIN32
 
+#include <TEnv.h>
+
 #include <filesystem>
 
 #include "TRestDataBase.h"
@@ -47,6 +49,39 @@ using namespace std;
 
 std::mutex mutex_read;
 
+namespace {
+// A condition of TRestRun::GetEventEntriesWithConditions(), parsed once before the entries are read
+struct EventCondition {
+    enum Comparison { kEqual, kLess, kLessEqual, kGreater, kGreaterEqual };
+
+    string observable;
+    Comparison comparison;
+    Double_t value;
+
+    // Clear the flag of the entries whose value does not satisfy the condition. The comparison is
+    // chosen once for the whole column, so each loop can be vectorized
+    void Apply(const Double_t* column, Long64_t n, char* pass) const {
+        switch (comparison) {
+            case kEqual:
+                for (Long64_t k = 0; k < n; k++) pass[k] &= column[k] == value;
+                break;
+            case kLess:
+                for (Long64_t k = 0; k < n; k++) pass[k] &= column[k] < value;
+                break;
+            case kLessEqual:
+                for (Long64_t k = 0; k < n; k++) pass[k] &= column[k] <= value;
+                break;
+            case kGreater:
+                for (Long64_t k = 0; k < n; k++) pass[k] &= column[k] > value;
+                break;
+            case kGreaterEqual:
+                for (Long64_t k = 0; k < n; k++) pass[k] &= column[k] >= value;
+                break;
+        }
+    }
+};
+}  // namespace
+
 ClassImp(TRestRun);
 
 TRestRun::TRestRun() { Initialize(); }
@@ -63,7 +98,11 @@ TRestRun::TRestRun(const string& filename) {
     }
 }
 
-TRestRun::~TRestRun() { CloseFile(); }
+TRestRun::~TRestRun() {
+    StopPrefetch();
+    for (auto reader : fFileReaders) delete reader;
+    CloseFile();
+}
 
 ///////////////////////////////////////////////
 /// \brief Set variables by default during initialization.
@@ -108,6 +147,18 @@ void TRestRun::Initialize() {
     fEventBranchLoc = -1;
     fFileProcess = nullptr;
     fSaveHistoricData = true;
+
+    fTreeCacheSize = 30000000;
+    fAsyncPrefetch = false;
+    fAsyncPrefetchingEnv = -1;
+    fLazyEventLoading = false;
+
+    fPrefetchEvents = 0;
+    fPrefetchFree = nullptr;
+    fPrefetchReady = nullptr;
+    fPrefetchCurrent = nullptr;
+
+    fInputFileReaders = 1;
 }
 
 ///////////////////////////////////////////////
@@ -352,6 +403,12 @@ void TRestRun::OpenInputFile(const TString& filename, const string& mode) {
     }
 
     if (TRestTools::isRootFile((string)filename)) {
+        // it must be set before opening the file, and kept while the input is read, as the caches of
+        // the split files of a chain are created later. CloseFile() restores the previous value
+        if (fAsyncPrefetch) {
+            if (fAsyncPrefetchingEnv < 0) fAsyncPrefetchingEnv = gEnv->GetValue("TFile.AsyncPrefetching", 0);
+            gEnv->SetValue("TFile.AsyncPrefetching", 1);
+        }
         fInputFile = TFile::Open(filename, mode.c_str());
 
         if (GetMetadataClass("TRestRun", fInputFile)) {
@@ -454,6 +511,39 @@ void TRestRun::AddInputFileExternal(const string& file) {
         fInputFileNames.push_back(file);
     }
     mutex_read.unlock();
+    fFileWatcher.Wake();
+}
+
+///////////////////////////////////////////////
+/// \brief Keep waiting for more input at the end of the input files
+///
+/// The external file process is then called again until it yields a new event,
+/// or until ReleaseEndFile() is called. Meanwhile the reader sleeps until a file
+/// in the directories of the input files is written or created, see
+/// TRestFileWatcher, or for one second at most.
+void TRestRun::HangUpEndFile() {
+    fHangUpEndFile = true;
+
+    std::set<string> directories;
+    directories.insert(TRestTools::SeparatePathAndName((string)fInputFileName).first);
+    for (const auto& file : fInputFileNames) {
+        directories.insert(TRestTools::SeparatePathAndName((string)file).first);
+    }
+    for (auto directory : directories) {
+        if (directory == "") directory = ".";
+        if (!fFileWatcher.Watch(directory)) {
+            RESTWarning << "Cannot watch the input directory " << directory << ", new data is polled"
+                        << RESTendl;
+        }
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Stop waiting for more input, the run ends at the end of the input files
+///
+void TRestRun::ReleaseEndFile() {
+    fHangUpEndFile = false;
+    fFileWatcher.Wake();
 }
 
 void TRestRun::ReadInputFileMetadata() {
@@ -654,6 +744,76 @@ void TRestRun::ReadInputFileTrees() {
             RESTDebug << "This is a pure analysis file!" << RESTendl;
             fInputEvent = nullptr;
         }
+
+        ConfigureTreeCache();
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Set up the TTreeCache of the input trees for the branches we read
+///
+/// GetNextEvent() reads all the observables of the analysis tree and only the
+/// input event branch of the event tree. These branches are registered in the
+/// cache of their tree at once, skipping the learning phase, so that the
+/// baskets of many entries are fetched with a few large reads, also from the
+/// split files of a chain. With `asyncPrefetch` ON (OFF by default) ROOT reads
+/// the next baskets on a background thread while the current ones are used.
+/// It sets `TFile.AsyncPrefetching` in gEnv, for the whole process, until the
+/// input file is closed by CloseFile(), which restores the previous value.
+///
+/// \code
+/// <TRestRun name="Run" >
+///     <parameter name="treeCacheSize" value="100000000"/>
+///     <parameter name="asyncPrefetch" value="ON"/>
+///     ...
+/// \endcode
+///
+/// `treeCacheSize` is given in bytes for each tree, 30 MB by default. 0 turns
+/// the cache off. The efficiency of the cache is shown by
+/// PrintTreeCacheStatistics().
+void TRestRun::ConfigureTreeCache() {
+    if (fTreeCacheSize <= 0) return;
+
+    if (fAnalysisTree != nullptr) {
+        // the chain of split files if any, otherwise the tree itself
+        TTree* tree = fAnalysisTree->GetTree();
+        tree->SetCacheSize(fTreeCacheSize);
+        tree->AddBranchToCache("*", true);
+        tree->StopCacheLearningPhase();
+    }
+    // the few entries read by LoadEvent() are not worth caching
+    if (fEventTree != nullptr && !fLazyEventLoading) {
+        fEventTree->SetCacheSize(fTreeCacheSize);
+        if (fInputEvent != nullptr) {
+            string brname = (string)fInputEvent->ClassName() + "Branch";
+            fEventTree->AddBranchToCache(brname.c_str(), true);
+        } else {
+            fEventTree->AddBranchToCache("*", true);
+        }
+        fEventTree->StopCacheLearningPhase();
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Print the efficiency of the cache of the input trees: the fraction
+/// of the baskets read which were found in the cache, and the number of read
+/// calls to the file
+///
+/// For split files, only the file being read is reported.
+void TRestRun::PrintTreeCacheStatistics() {
+    if (fInputFile == nullptr) return;
+    vector<pair<string, TTree*>> trees = {{"AnalysisTree", nullptr}, {"EventTree", fEventTree}};
+    if (fAnalysisTree != nullptr) trees[0].second = fAnalysisTree->GetTree();
+    for (auto& tree : trees) {
+        if (tree.second == nullptr || tree.second->GetCurrentFile() == nullptr) continue;
+        TTreeCache* cache = tree.second->GetReadCache(tree.second->GetCurrentFile());
+        if (cache == nullptr) {
+            RESTcout << tree.first << " : no tree cache" << RESTendl;
+            continue;
+        }
+        RESTcout << tree.first << " cache : " << cache->GetBufferSize() / 1000000. << " MB, hit rate "
+                 << cache->GetEfficiency() * 100 << "%, "
+                 << tree.second->GetCurrentFile()->GetReadCalls() << " read calls" << RESTendl;
     }
 }
 
@@ -795,9 +955,12 @@ void TRestRun::ReadFileInfo(const string& filename) {
 /// the process to reload the file.
 void TRestRun::ResetEntry() {
     fCurrentEvent = 0;
+    // the events decoded ahead are dropped, the file process starts again
+    StopPrefetch();
     if (fFileProcess != nullptr) {
         fFileProcess->ResetEntry();
     }
+    for (auto reader : fFileReaders) reader->ResetEntry();
 }
 
 ///////////////////////////////////////////////
@@ -808,18 +971,26 @@ void TRestRun::ResetEntry() {
 /// writing event data into target event calls the method TRestEvent::CloneTo()
 /// writing observable data into target analysistree calls memcpy
 /// It requires same branch structure, but we didn't verify it here.
+///
+/// The events of an external file process are decoded ahead by a prefetch
+/// thread, see StartPrefetch().
+///
+/// fInputEvent is only changed and cloned holding mutex_read, as LoadEvent() may
+/// use it at the same time from the threads.
 Int_t TRestRun::GetNextEvent(TRestEvent* targetevt, TRestAnalysisTree* targettree) {
     bool messageShown = false;
     TRestEvent* eve = fInputEvent;
+    // held until the event is cloned to targetevt
+    std::unique_lock<std::mutex> lock(mutex_read, std::defer_lock);
 
-    if (fFileProcess != nullptr) {
+    if (fFileProcess != nullptr && fPrefetchEvents > 0) {
+        RESTDebug << "TRestRun: getting next event from prefetch thread" << RESTendl;
+        eve = GetPrefetchedEvent();
+        fCurrentEvent++;
+    } else if (fFileProcess != nullptr) {
         RESTDebug << "TRestRun: getting next event from external process" << RESTendl;
     GetEventExt:
-        mutex_read.lock();
-        fFileProcess->BeginOfEventProcess();
-        eve = fFileProcess->ProcessEvent(nullptr);
-        fFileProcess->EndOfEventProcess();
-        mutex_read.unlock();
+        eve = ReadExternalEvent(fFileProcess);
         fBytesRead = fFileProcess->GetTotalBytesRead();
         // if (targettree != nullptr) {
         //    for (int n = 0; n < fAnalysisTree->GetNumberOfObservables(); n++)
@@ -836,25 +1007,23 @@ Int_t TRestRun::GetNextEvent(TRestEvent* targetevt, TRestAnalysisTree* targettre
             if (fCurrentEvent >= fAnalysisTree->GetTree()->GetEntriesFast()) {
                 eve = nullptr;
             } else {
-                if (targettree != nullptr) {
+                // LoadEvent() may read the same file from the threads
+                lock.lock();
+                bool lazy = fLazyEventLoading && fEventTree != nullptr;
+                if (targettree != nullptr || lazy) {
                     // normal reading procedure
                     eve->Initialize();
                     fBytesRead += fAnalysisTree->GetEntry(fCurrentEvent);
+                }
+                if (targettree != nullptr) {
                     targettree->SetEventInfo(fAnalysisTree);
                     for (int n = 0; n < fAnalysisTree->GetNumberOfObservables(); n++)
                         targettree->SetObservable(n, fAnalysisTree->GetObservable(n));
                 }
-                if (fEventTree != nullptr) {
-                    if (fEventTree->IsA() == TChain::Class()) {
-                        Long64_t entry = fEventTree->LoadTree(fCurrentEvent);
-                        fBytesRead += ((TBranch*)fEventTree->GetTree()->GetListOfBranches()->UncheckedAt(
-                                           fEventBranchLoc))
-                                          ->GetEntry(entry);
-                    } else {
-                        fBytesRead +=
-                            ((TBranch*)fEventTree->GetListOfBranches()->UncheckedAt(fEventBranchLoc))
-                                ->GetEntry(fCurrentEvent);
-                    }
+                if (lazy) {
+                    SetLazyEvent(eve, fCurrentEvent);
+                } else if (fEventTree != nullptr) {
+                    fBytesRead += ReadEventBranch(fCurrentEvent);
                 }
                 fCurrentEvent++;
             }
@@ -864,24 +1033,28 @@ Int_t TRestRun::GetNextEvent(TRestEvent* targetevt, TRestAnalysisTree* targettre
     // cout << fHangUpEndFile << endl;
 
     if (eve == nullptr) {
-        if (fHangUpEndFile && fFileProcess != nullptr) {
+        // with prefetch, the prefetch thread waits for more files itself
+        if (fHangUpEndFile && fFileProcess != nullptr && fPrefetchEvents <= 0) {
             // if hangup is set, we continue calling ProcessEvent() of the
             // external process, until there is non-null event yielded
             if (!messageShown) {
                 RESTEssential << "external process file reading reaches end, waiting for more files"
                               << RESTendl;
             }
-            usleep(1000000);
+            fFileWatcher.Wait(1);
             messageShown = true;
             fCurrentEvent--;
             goto GetEventExt;
         }
-        fInputEvent = eve;
-        // if (fFileProcess != nullptr) fFileProcess->EndProcess();
-        return -1;
     }
 
+    // the external events are decoded before it is taken, see ReadExternalEvent()
+    if (!lock.owns_lock()) lock.lock();
     fInputEvent = eve;
+    if (eve == nullptr) {
+        // if (fFileProcess != nullptr) fFileProcess->EndProcess();
+        return -1;
+    }
 
     if (fInputEvent->GetID() == 0 && fInputEvent->GetSubID() == 0) {
         fInputEvent->SetID(fCurrentEvent - 1);
@@ -897,8 +1070,144 @@ Int_t TRestRun::GetNextEvent(TRestEvent* targetevt, TRestAnalysisTree* targettre
     return 0;
 }
 
+///////////////////////////////////////////////
+/// \brief Decode the next event with the given file process, fFileProcess or one
+/// of the file readers
+///
+/// Returns the output event of the process, or nullptr at the end of its input.
+TRestEvent* TRestRun::ReadExternalEvent(TRestEventProcess* process) {
+    // files added at run time go to fFileProcess, the file readers have their own files
+    std::unique_lock<std::mutex> lock(mutex_read, std::defer_lock);
+    if (process == fFileProcess) lock.lock();
+    process->BeginOfEventProcess();
+    TRestEvent* eve = process->ProcessEvent(nullptr);
+    process->EndOfEventProcess();
+    return eve;
+}
+
+///////////////////////////////////////////////
+/// \brief Start the thread decoding the events of the external file process ahead
+///
+/// With an external file process (raw data decoder) and `prefetchEvents` > 0,
+/// the decoding of the events runs on a dedicated thread, which keeps up to
+/// `prefetchEvents` decoded events in a queue. GetNextEvent() then just takes
+/// the next one, so that the file reading and unpacking overlap with the
+/// processing of the previous events:
+///
+/// \code
+/// <TRestRun name="SJTU_Proto" >
+///     <parameter name="inputFormat" value="run[RunNumber]_file[Fragment]_[Time-d--]"/>
+///     <parameter name="prefetchEvents" value="64"/>
+///     ...
+/// \endcode
+///
+/// It is 0 by default: the events are decoded on the thread calling
+/// GetNextEvent(), and the pause menu can still fork the process, which is
+/// disabled while the decoder thread runs. The thread is started at the first
+/// event read, and stopped by ResetEntry() or at the end of the input.
+///
+/// With many input files, `inputFileReaders` sets the number of files decoded at
+/// once, see SetExtProcess(). Each file reader has its own prefetch thread, all of
+/// them filling the same queue, so the events of different files are not read in
+/// a reproducible order.
+void TRestRun::StartPrefetch() {
+    Int_t nReaders = fFileReaders.size() + 1;
+    fPrefetchSlots.resize(fPrefetchEvents + nReaders);
+    fPrefetchFree = new TRestBoundedQueue<TRestPrefetchedEvent*>(fPrefetchSlots.size());
+    fPrefetchReady = new TRestBoundedQueue<TRestPrefetchedEvent*>(fPrefetchSlots.size());
+    for (auto& slot : fPrefetchSlots) fPrefetchFree->Push(&slot);
+    fPrefetchCurrent = nullptr;
+    fReaderBytesRead.assign(nReaders, 0);
+    fPrefetchRunning = nReaders;
+    for (int r = 0; r < nReaders; r++) fPrefetchThreads.emplace_back(&TRestRun::PrefetchLoop, this, r);
+}
+
+///////////////////////////////////////////////
+/// \brief Stop the prefetch thread and release the decoded events
+///
+void TRestRun::StopPrefetch() {
+    if (fPrefetchThreads.empty()) return;
+    fPrefetchFree->Close();
+    fPrefetchReady->Close();
+    fFileWatcher.Wake();
+    for (auto& t : fPrefetchThreads) t.join();
+    fPrefetchThreads.clear();
+
+    // fInputEvent may be one of the slots
+    if (fFileProcess != nullptr) fInputEvent = fFileProcess->GetOutputEvent();
+    for (auto& slot : fPrefetchSlots) delete slot.fEvent;
+    fPrefetchSlots.clear();
+    delete fPrefetchFree;
+    delete fPrefetchReady;
+    fPrefetchFree = nullptr;
+    fPrefetchReady = nullptr;
+    fPrefetchCurrent = nullptr;
+}
+
+///////////////////////////////////////////////
+/// \brief Main loop of the prefetch thread of the file reader **reader**,
+/// decoding events into free slots until the end of its input
+///
+/// The queue of decoded events is closed when the last file reader is over.
+void TRestRun::PrefetchLoop(Int_t reader) {
+    TRestEventProcess* process = reader == 0 ? fFileProcess : fFileReaders[reader - 1];
+    bool messageShown = false;
+    TRestPrefetchedEvent* slot = nullptr;
+    while (fPrefetchFree->Pop(slot)) {
+        TRestEvent* eve = ReadExternalEvent(process);
+        // only fFileProcess gets the files added later
+        while (eve == nullptr && reader == 0 && fHangUpEndFile && !fPrefetchFree->IsClosed()) {
+            // if hangup is set, we continue calling ProcessEvent() of the
+            // external process, until there is non-null event yielded
+            if (!messageShown) {
+                RESTEssential << "external process file reading reaches end, waiting for more files"
+                              << RESTendl;
+            }
+            messageShown = true;
+            fFileWatcher.Wait(1);
+            eve = ReadExternalEvent(process);
+        }
+        if (eve == nullptr) {
+            fPrefetchFree->Push(slot);
+            break;
+        }
+        messageShown = false;
+
+        if (slot->fEvent == nullptr) slot->fEvent = REST_Reflection::Assembly(eve->ClassName());
+        slot->fEvent->Initialize();
+        eve->CloneTo(slot->fEvent);
+        slot->fBytesRead = process->GetTotalBytesRead();
+        slot->fReader = reader;
+        if (!fPrefetchReady->Push(slot)) break;
+    }
+    if (--fPrefetchRunning == 0) fPrefetchReady->Close();
+}
+
+///////////////////////////////////////////////
+/// \brief Take the next event decoded by the prefetch thread. The slot of the
+/// previous one goes back to the thread.
+///
+/// Returns nullptr at the end of the input.
+TRestEvent* TRestRun::GetPrefetchedEvent() {
+    if (fPrefetchReady == nullptr) StartPrefetch();
+    if (fPrefetchCurrent != nullptr) {
+        fPrefetchFree->Push(fPrefetchCurrent);
+        fPrefetchCurrent = nullptr;
+    }
+    TRestPrefetchedEvent* slot = nullptr;
+    if (!fPrefetchReady->Pop(slot)) return nullptr;
+    fPrefetchCurrent = slot;
+    fReaderBytesRead[slot->fReader] = slot->fBytesRead;
+    fBytesRead = 0;
+    for (auto bytes : fReaderBytesRead) fBytesRead += bytes;
+    return slot->fEvent;
+}
+
 ///////////////////////////////////////////////
 /// \brief Calls GetEntry() for both AnalysisTree and EventTree
+///
+/// With `lazyEventLoading` ON, the EventTree is only read when the event is
+/// needed, by LoadEvent() or GetInputEvent<T>().
 void TRestRun::GetEntry(Long64_t entry) {
     if (entry >= GetEntries()) {
         RESTWarning << "TRestRun::GetEntry. Entry requested out of limits" << RESTendl;
@@ -908,8 +1217,11 @@ void TRestRun::GetEntry(Long64_t entry) {
     if (fAnalysisTree != nullptr) {
         fAnalysisTree->GetEntry(entry);
     }
-    if (fEventTree != nullptr) {
+    if (fLazyEventLoading && fAnalysisTree != nullptr && fInputEvent != nullptr) {
+        SetLazyEvent(fInputEvent, entry);
+    } else if (fEventTree != nullptr) {
         fEventTree->GetEntry(entry);
+        if (fInputEvent != nullptr) fInputEvent->SetLazyEntry(-1);
     }
 
     if (fInputEvent != nullptr) {
@@ -919,6 +1231,76 @@ void TRestRun::GetEntry(Long64_t entry) {
     fCurrentEvent = entry;
 }
 
+///////////////////////////////////////////////
+/// \brief Read the data of **event** from the input EventTree, if it was
+/// skipped by `lazyEventLoading`
+///
+/// \code
+/// <TRestRun name="Run" >
+///     <parameter name="lazyEventLoading" value="ON"/>
+///     ...
+/// \endcode
+///
+/// With `lazyEventLoading` ON, GetNextEvent() and GetEntry() only read the
+/// AnalysisTree entry. The event gets its ID, time and tag from it, and keeps
+/// the entry, see TRestEvent::GetLazyEntry(). Its data is read by this method
+/// when it is needed. TRestThread calls it before the first process that reads
+/// the event data, see TRestEventProcess::readsEventData(), and before the event
+/// is saved. The events rejected by the processes which only use the
+/// observables or the event information are therefore never read from the
+/// EventTree.
+///
+/// It can be called from the threads of TRestProcessRunner.
+void TRestRun::LoadEvent(TRestEvent* event) {
+    Long64_t entry = event->GetLazyEntry();
+    if (entry < 0 || fEventTree == nullptr) return;
+
+    std::lock_guard<std::mutex> lock(mutex_read);
+    fInputEvent->Initialize();
+    fBytesRead += ReadEventBranch(entry);
+    fInputEvent->SetLazyEntry(-1);
+
+    // as in GetNextEvent()
+    if (fInputEvent->GetID() == 0 && fInputEvent->GetSubID() == 0) {
+        fInputEvent->SetID(entry);
+    }
+    if (fInputEvent->GetRunOrigin() == 0) {
+        fInputEvent->SetRunOrigin(fRunNumber);
+    }
+
+    if (event == fInputEvent) {
+        fInputEvent->InitializeReferences(this);
+    } else {
+        event->Initialize();
+        fInputEvent->CloneTo(event);
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Read the input event branch at the given entry into fInputEvent, and
+/// return the number of bytes read
+Long64_t TRestRun::ReadEventBranch(Long64_t entry) {
+    if (fEventTree->IsA() == TChain::Class()) {
+        Long64_t localEntry = fEventTree->LoadTree(entry);
+        return ((TBranch*)fEventTree->GetTree()->GetListOfBranches()->UncheckedAt(fEventBranchLoc))
+            ->GetEntry(localEntry);
+    }
+    return ((TBranch*)fEventTree->GetListOfBranches()->UncheckedAt(fEventBranchLoc))->GetEntry(entry);
+}
+
+///////////////////////////////////////////////
+/// \brief Give **event** the information of the current AnalysisTree entry, and
+/// leave its data to be read by LoadEvent()
+void TRestRun::SetLazyEvent(TRestEvent* event, Long64_t entry) {
+    event->SetRunOrigin(fAnalysisTree->GetRunOrigin());
+    event->SetSubRunOrigin(fAnalysisTree->GetSubRunOrigin());
+    event->SetID(fAnalysisTree->GetEventID());
+    event->SetSubID(fAnalysisTree->GetSubEventID());
+    event->SetTime(fAnalysisTree->GetTimeStamp());
+    event->SetSubEventTag(fAnalysisTree->GetSubEventTag());
+    event->SetLazyEntry(entry);
+}
+
 ///////////////////////////////////////////////
 /// \brief Form output file name according to file info list, proc info list and
 /// run data.
@@ -976,7 +1358,11 @@ TString TRestRun::FormFormat(const TString& FilenameFormat) {
 /// Merging is by calling TFileMerger. After this, it will format the merged file name.
 /// This method is used to create output file after TRestProcessRunner is finished.
 /// The metadata objects will also be written into the file.
-TFile* TRestRun::MergeToOutputFile(vector<string> filenames, string outputfilename) {
+///
+/// Files which are already open, e.g. the TMemFile of each thread, can be given
+/// in **files**. They are merged together with the files in **filenames**, but
+/// they are not removed afterwards.
+TFile* TRestRun::MergeToOutputFile(vector<string> filenames, string outputfilename, vector<TFile*> files) {
     RESTDebug << "TRestRun::FormOutputFile. target : " << outputfilename << RESTendl;
     string filename;
     TFileMerger* m = new TFileMerger(false);
@@ -995,6 +1381,10 @@ TFile* TRestRun::MergeToOutputFile(vector<string> filenames, string outputfilena
     for (int i = 0; i < filenames.size(); i++) {
         m->AddFile(filenames[i].c_str(), false);
     }
+    // files already open, e.g. TMemFile, are read directly from memory
+    for (auto f : files) {
+        m->AddFile(f, false);
+    }
 
     if (m->Merge()) {
         for (int i = 0; i < filenames.size(); i++) {
@@ -1152,6 +1542,7 @@ void TRestRun::CloseFile() {
         fEntriesSaved = fAnalysisTree->GetEntries();
         if (fAnalysisTree->GetEntries() > 0 && fInputFile == nullptr) {
             if (fOutputFile != nullptr) {
+                fAnalysisTree->BuildEventIndex();
                 fAnalysisTree->Write(nullptr, kOverwrite);
                 this->Write(nullptr, kOverwrite);
             }
@@ -1187,34 +1578,105 @@ void TRestRun::CloseFile() {
         fInputFile->Close();
         fInputFile = nullptr;
     }
+    if (fAsyncPrefetchingEnv >= 0) {
+        gEnv->SetValue("TFile.AsyncPrefetching", fAsyncPrefetchingEnv);
+        fAsyncPrefetchingEnv = -1;
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Returns the number of file processes that will decode the input files
+/// at once, as set by the parameter `inputFileReaders`
+///
+/// It is limited to the number of input files, and it is 1 without prefetch.
+Int_t TRestRun::GetNumberOfFileReaders() const {
+    if (fPrefetchEvents <= 0 || fInputFileReaders <= 1) return 1;
+    return min((Int_t)fInputFileNames.size(), fInputFileReaders);
 }
 
 ///////////////////////////////////////////////
 /// \brief Set external file process
 ///
-void TRestRun::SetExtProcess(TRestEventProcess* p) {
+/// The given **readers** are copies of the process **p**. They decode their share
+/// of the input files at the same time as **p**, each on its own prefetch thread:
+///
+/// \code
+/// <TRestRun name="SJTU_Proto" >
+///     <parameter name="inputFileName" value="run00042_*.aqs"/>
+///     <parameter name="inputFileReaders" value="4"/>
+///     ...
+/// \endcode
+///
+/// The input files are dealt out to the file processes one after the other. The
+/// run information is the one found by **p**, which opens the first file. The
+/// file readers must yield the same event type and the same run number.
+///
+/// The events of the file readers are interleaved in the order they are decoded,
+/// which changes from one run to the next. `sortOutputEvents` keeps the output in
+/// the order the events were read, so with more than one reader the order of the
+/// output events is not reproducible either. Only the events of each input file
+/// keep their order. Set `inputFileReaders` to 1 when the order matters.
+void TRestRun::SetExtProcess(TRestEventProcess* p, const vector<TRestEventProcess*>& readers) {
     if (fFileProcess == nullptr && p != nullptr) {
         fFileProcess = p;
 
-        fFileProcess->OpenInputFiles(Vector_cast<TString, string>(fInputFileNames));
+        vector<string> files = Vector_cast<TString, string>(fInputFileNames);
+        Int_t nReaders = readers.size() + 1;
+        vector<string> share;
+        for (unsigned int i = 0; i < files.size(); i += nReaders) share.push_back(files[i]);
+        fFileProcess->OpenInputFiles(share);
         fFileProcess->InitProcess();
         fInputEvent = fFileProcess->GetOutputEvent();
         if (fInputEvent == nullptr) {
             RESTError << "The external process \"" << p->GetName() << "\" doesn't yield any output event!"
                       << RESTendl;
             exit(1);
-        } else {
-            fInputEvent->SetRunOrigin(fRunNumber);
-            fInputEvent->SetSubRunOrigin(fParentRunNumber);
-            fInputEvent->SetTimeStamp(fStartTime);
         }
+
+        // the file readers may also update the run information from their files
+        Int_t runNumber = fRunNumber;
+        Double_t startTime = fStartTime;
+        for (int r = 1; r < nReaders; r++) {
+            TRestEventProcess* reader = readers[r - 1];
+            share.clear();
+            for (unsigned int i = r; i < files.size(); i += nReaders) share.push_back(files[i]);
+            reader->OpenInputFiles(share);
+            reader->InitProcess();
+            if (reader->GetOutputEvent() == nullptr ||
+                reader->GetOutputEvent()->IsA() != fInputEvent->IsA()) {
+                RESTError << "File reader " << r << " of the external process \"" << p->GetName()
+                          << "\" doesn't yield " << fInputEvent->ClassName() << "!" << RESTendl;
+                exit(1);
+            }
+            if (fRunNumber != runNumber) {
+                RESTError << "The input file " << share[0] << " belongs to run " << fRunNumber
+                          << ", not to run " << runNumber << "!" << RESTendl;
+                exit(1);
+            }
+            fStartTime = startTime;
+            // only fFileProcess fills the analysis tree of the run
+            reader->SetAnalysisTree(nullptr);
+            fFileReaders.push_back(reader);
+        }
+        if (nReaders > 1) {
+            RESTInfo << nReaders << " file readers decode the " << files.size() << " input files at once"
+                     << RESTendl;
+        }
+
+        fInputEvent->SetRunOrigin(fRunNumber);
+        fInputEvent->SetSubRunOrigin(fParentRunNumber);
+        fInputEvent->SetTimeStamp(fStartTime);
         fInputFile = nullptr;
         // we make sure external processes can access to analysis tree
         fAnalysisTree = new TRestAnalysisTree("externalProcessAna", "externalProcessAna");
         p->SetAnalysisTree(fAnalysisTree);
-        fTotalBytes = p->GetTotalBytes();
+        fTotalBytes = GetTotalBytes();
 
+        // the first event is decoded at once, as fInputEvent is the output event of the process
+        Int_t prefetchEvents = fPrefetchEvents;
+        fPrefetchEvents = 0;
         GetNextEvent(fInputEvent, nullptr);
+        fPrefetchEvents = prefetchEvents;
         // fAnalysisTree->CreateBranches();
         RESTInfo << "The external file process has been set! Name : " << fFileProcess->GetName() << RESTendl;
     } else {
@@ -1351,6 +1813,7 @@ Double_t TRestRun::GetRunLength() const {
 Long64_t TRestRun::GetTotalBytes() {
     if (fFileProcess != nullptr) {
         fTotalBytes = fFileProcess->GetTotalBytes();
+        for (auto reader : fFileReaders) fTotalBytes += reader->GetTotalBytes();
     }
     return fTotalBytes;
 }
@@ -1365,6 +1828,22 @@ Long64_t TRestRun::GetEntries() const {
 // Getters
 TRestEvent* TRestRun::GetEventWithID(Int_t eventID, Int_t subEventID, const TString& tag) {
     if (fAnalysisTree != nullptr) {
+        // look the entry up in the event index of the analysis tree
+        Long64_t entry = fAnalysisTree->GetEntryWithEventID(eventID, subEventID);
+        if (entry >= 0) {
+            fAnalysisTree->GetEntry(entry);
+            if (fAnalysisTree->GetEventID() != eventID) return nullptr;
+            if (tag == "" || fAnalysisTree->GetSubEventTag() == tag) {
+                if (fEventTree != nullptr) fEventTree->GetEntry(entry);
+                if (fInputEvent != nullptr) fInputEvent->SetLazyEntry(-1);
+                fCurrentEvent = entry;
+                return fInputEvent;
+            }
+        } else if (fAnalysisTree->HasEventIndex()) {
+            return nullptr;
+        }
+
+        // without index, or for another tag of the event, the entries are read one by one
         int nEntries = fAnalysisTree->GetEntries();
 
         // set analysis tree to read only three branches
@@ -1373,14 +1852,13 @@ TRestEvent* TRestRun::GetEventWithID(Int_t eventID, Int_t subEventID, const TStr
         fAnalysisTree->SetBranchStatus("subEventID", true);
         fAnalysisTree->SetBranchStatus("subEventTag", true);
 
-        // just look through the whole analysis tree and find the entry
-        // this is not good!
         for (int i = 0; i < nEntries; i++) {
             fAnalysisTree->GetEntry(i);
             if (fAnalysisTree->GetEventID() == eventID) {
                 if (subEventID != -1 && fAnalysisTree->GetSubEventID() != subEventID) continue;
                 if (tag != "" && fAnalysisTree->GetSubEventTag() != tag) continue;
                 if (fEventTree != nullptr) fEventTree->GetEntry(i);
+                if (fInputEvent != nullptr) fInputEvent->SetLazyEntry(-1);
                 fAnalysisTree->SetBranchStatus("*", true);
                 fAnalysisTree->GetEntry(i);
                 fCurrentEvent = i;
@@ -1396,23 +1874,24 @@ TRestEvent* TRestRun::GetEventWithID(Int_t eventID, Int_t subEventID, const TStr
 std::vector<int> TRestRun::GetEventEntriesWithConditions(const string& cuts, int startingIndex,
                                                          int maxNumber) {
     std::vector<int> eventIds;
-    // parsing cuts
-    std::vector<string> observables;
-    std::vector<string> operators;
-    std::vector<Double_t> values;
+    // parsing cuts, once for all the entries
+    std::vector<EventCondition> conditions;
     // it is necessary that this vector is sorted from longest to shortest
-    const std::vector<string> validOperators = {"==", "<=", ">=", "=", ">", "<"};
+    const std::vector<std::pair<string, EventCondition::Comparison>> validOperators = {
+        {"==", EventCondition::kEqual},        {"<=", EventCondition::kLessEqual},
+        {">=", EventCondition::kGreaterEqual}, {"=", EventCondition::kEqual},
+        {">", EventCondition::kGreater},       {"<", EventCondition::kLess}};
 
     vector<string> cutsVector = Split(cuts, "&&", false, true);
 
     for (int i = 0; i < cutsVector.size(); i++) {
         string cut = cutsVector[i];
         for (int j = 0; j < validOperators.size(); j++) {
-            if (cut.find(validOperators[j]) != string::npos) {
-                operators.push_back(validOperators[j]);
-                observables.push_back((string)cut.substr(0, cut.find(validOperators[j])));
-                values.push_back(std::stod((string)cut.substr(
-                    cut.find(validOperators[j]) + validOperators[j].length(), string::npos)));
+            const string& op = validOperators[j].first;
+            size_t position = cut.find(op);
+            if (position != string::npos) {
+                conditions.push_back({(string)cut.substr(0, position), validOperators[j].second,
+                                      std::stod((string)cut.substr(position + op.length(), string::npos))});
                 break;
             }
         }
@@ -1429,19 +1908,11 @@ std::vector<int> TRestRun::GetEventEntriesWithConditions(const string& cuts, int
         branchNames.insert((string)branches->At(i)->GetName());
     }
     // verify all observables in cuts are branch names
-    for (int i = 0; i < observables.size(); i++) {
-        // verify operators
-        if (std::find(validOperators.begin(), validOperators.end(), operators[i]) == validOperators.end()) {
-            // invalid operation
-            cout << "invalid operation '" << operators[i] << "' for 'TRestRun::GetEventIdsWithConditions'"
-                 << endl;
-            return eventIds;
-        }
-        // verify observables
-        if (branchNames.count(observables[i]) == 0) {
+    for (int i = 0; i < conditions.size(); i++) {
+        if (branchNames.count(conditions[i].observable) == 0) {
             // invalid observable name
-            cout << "invalid observable '" << observables[i] << "' for 'TRestRun::GetEventIdsWithConditions'"
-                 << endl;
+            cout << "invalid observable '" << conditions[i].observable
+                 << "' for 'TRestRun::GetEventIdsWithConditions'" << endl;
             cout << "valid branch names: ";
             for (auto branchName : branchNames) {
                 cout << branchName << " ";
@@ -1450,43 +1921,49 @@ std::vector<int> TRestRun::GetEventEntriesWithConditions(const string& cuts, int
             return eventIds;
         }
     }
-    // read only the necessary branches
-    fAnalysisTree->SetBranchStatus("*", false);
-    for (int i = 0; i < observables.size(); i++) {
-        fAnalysisTree->SetBranchStatus(observables[i].c_str(), true);
-    }
-    // comparison code
-    Double_t valueToCompareFrom;
-    bool comparisonResult;
-    int i;
-    for (int iNoOffset = 0; iNoOffset < nEntries; iNoOffset++) {
-        i = (iNoOffset + startingIndex) % nEntries;
-        fAnalysisTree->GetEntry(i);
-        comparisonResult = true;
-        for (int j = 0; j < observables.size(); j++) {
-            valueToCompareFrom = fAnalysisTree->GetDblObservableValue(observables[j].c_str());
-            if (operators[j] == "=" || operators[j] == "==") {
-                comparisonResult = comparisonResult && (valueToCompareFrom == values[j]);
-            } else if (operators[j] == "<") {
-                comparisonResult = comparisonResult && (valueToCompareFrom < values[j]);
-            } else if (operators[j] == "<=") {
-                comparisonResult = comparisonResult && (valueToCompareFrom <= values[j]);
-            } else if (operators[j] == ">") {
-                comparisonResult = comparisonResult && (valueToCompareFrom > values[j]);
-            } else if (operators[j] == ">=") {
-                comparisonResult = comparisonResult && (valueToCompareFrom >= values[j]);
+    if (nEntries <= 0) {
+        return eventIds;
+    }
+
+    // the entries are taken in chunks. TTree::Draw() reads the whole column of each observable from
+    // its baskets, only the branches of the observables are read, and each condition is evaluated on
+    // the whole column at once
+    const Long64_t chunkSize = min((Long64_t)1 << 20, (Long64_t)nEntries);
+    std::vector<char> pass(chunkSize);
+    TTree* tree = fAnalysisTree->GetTree();
+    const Long64_t estimate = tree->GetEstimate();
+    tree->SetEstimate(chunkSize + 1);
+
+    // the entries from startingIndex to the end, then from the beginning to startingIndex
+    bool done = false;
+    Long64_t n = 0;
+    for (Long64_t iNoOffset = 0; iNoOffset < nEntries && !done; iNoOffset += n) {
+        Long64_t first = (iNoOffset + startingIndex) % nEntries;
+        n = min(chunkSize, min(nEntries - iNoOffset, nEntries - first));
+
+        std::fill(pass.begin(), pass.begin() + n, 1);
+        for (int j = 0; j < conditions.size(); j++) {
+            Long64_t rows = tree->Draw(conditions[j].observable.c_str(), "", "goff", n, first);
+            if (rows != n) {
+                // an array or an object gives another number of values than entries
+                cout << "observable '" << conditions[j].observable
+                     << "' is not a number for 'TRestRun::GetEventIdsWithConditions'" << endl;
+                tree->SetEstimate(estimate);
+                return {};
             }
+            conditions[j].Apply(tree->GetV1(), n, pass.data());
         }
-        if (comparisonResult) {
-            if (eventIds.size() < maxNumber) {
-                eventIds.push_back(i);
-            } else {
+
+        for (Long64_t k = 0; k < n; k++) {
+            if (!pass[k]) continue;
+            if (maxNumber >= 0 && (int)eventIds.size() >= maxNumber) {
+                done = true;
                 break;
             }
+            eventIds.push_back(first + k);
         }
     }
-    // reset branch status
-    fAnalysisTree->SetBranchStatus("*", true);
+    tree->SetEstimate(estimate);
     return eventIds;
 }
 
@@ -1518,6 +1995,7 @@ TRestEvent* TRestRun::GetNextEventWithConditions(const string& cuts) {
     } else {
         fAnalysisTree->GetEntry(indices[0]);
         fEventTree->GetEntry(indices[0]);
+        fInputEvent->SetLazyEntry(-1);
         fCurrentEvent = indices[0];
         return fInputEvent;
     }
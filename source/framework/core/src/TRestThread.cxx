@@ -27,8 +27,8 @@
 
 using namespace std;
 
-#ifdef TIME_MEASUREMENT
 #include <chrono>
+#ifdef TIME_MEASUREMENT
 using namespace chrono;
 #endif
 
@@ -43,14 +43,19 @@ void TRestThread::Initialize() {
 
     fAnalysisTree = nullptr;
     fEventTree = nullptr;
+    fSavedEvents.clear();
 
     fOutputFile = nullptr;
 
     fProcessChain.clear();
+    fThreadPool = nullptr;
 
     isFinished = false;
+    fSequence = -1;
+    fNProcessedEvents = 0;
+    fLockWaitTime = 0;
 
-    fCompressionLevel = 1;
+    fCompressionSettings = 1;
     fVerboseLevel = TRestStringOutput::REST_Verbose_Level::REST_Essential;
 }
 
@@ -152,13 +157,28 @@ void TRestThread::SetThreadId(Int_t id) {
 /// when fOutputEvent address is determined.
 bool TRestThread::TestRun() {
     RESTDebug << "Processing ..." << RESTendl;
+    fSequence = -1;
     for (int i = 0; i < 5; i++) {
         TRestEvent* ProcessedEvent = fInputEvent;
+        LoadEventData(fInputEvent);
         RESTDebug << "Test run " << i << " : Input Event ---- " << fInputEvent->ClassName() << "("
                   << fInputEvent << ")" << RESTendl;
         for (unsigned int j = 0; j < fProcessChain.size(); j++) {
             RESTDebug << "t" << fThreadId << "p" << j << ": " << fProcessChain[j]->ClassName() << RESTendl;
 
+            if (fHostRunner->GetSerialStage(j) != nullptr) {
+                TRestEventProcess* p = fHostRunner->GetSerialStage(j)->GetProcess();
+                ProcessedEvent = ProcessSerialized(j, ProcessedEvent, true);
+                if (ProcessedEvent == nullptr && p->GetOutputEvent() != nullptr) {
+                    ProcessedEvent = CopySerialOutput(j, p->GetOutputEvent());
+                }
+                if (ProcessedEvent == nullptr) {
+                    RESTDebug << "  ----  NULL" << RESTendl;
+                    break;
+                }
+                continue;
+            }
+
             fProcessChain[j]->SetObservableValidation(true);
 
             fProcessChain[j]->BeginOfEventProcess(ProcessedEvent);
@@ -247,10 +267,10 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
 
     if (fProcessChain.size() > 0) {
         RESTDebug << "TRestThread: Creating file : " << threadFileName << RESTendl;
-        fOutputFile = new TFile(threadFileName.c_str(), "recreate");
-        fOutputFile->SetCompressionLevel(fCompressionLevel);
+        OpenOutputFile(threadFileName);
         fAnalysisTree = new TRestAnalysisTree("AnalysisTree_" + ToString(fThreadId), "dummyTree");
         fAnalysisTree->DisableQuickObservableValueSetting();
+        fHostRunner->SetObservableFilter(fAnalysisTree);
 
         RESTDebug << "TRestThread: Finding first input event of process chain..." << RESTendl;
         if (fHostRunner->GetInputEvent() == nullptr) {
@@ -283,6 +303,7 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
             for (unsigned int j = 0; j < fProcessChain.size(); j++) {
                 fProcessChain[i]->SetFriendProcess(fProcessChain[j]);
             }
+            if (IsSerialReplica(i)) continue;
             RESTDebug << "InitProcess() process for " << fProcessChain[i]->ClassName() << RESTendl;
             fProcessChain[i]->InitProcess();
         }
@@ -370,7 +391,10 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
 
         auto iter = branchesToAdd.begin();
         while (iter != branchesToAdd.end()) {
-            fEventTree->Branch(iter->first, iter->second->ClassName(), iter->second);
+            if (fHostRunner->IsEventBranchKept((string)iter->first)) {
+                fEventTree->Branch(iter->first, iter->second->ClassName(), iter->second);
+                fSavedEvents.push_back(iter->second);
+            }
             iter++;
         }
 
@@ -387,16 +411,21 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
         fOutputFile->cd();
         fOutputFile->Clear();
         for (unsigned int i = 0; i < fProcessChain.size(); i++) {
+            if (IsSerialReplica(i)) continue;
             fProcessChain[i]->InitProcess();
         }
 
+        // the events of the test run are not counted
+        fProfile.SetProcessChain(fProcessChain);
+        fNProcessedEvents = 0;
+        fLockWaitTime = 0;
+
         RESTDebug << "Thread " << fThreadId << " Ready!" << RESTendl;
     } else {
         string tmp = fHostRunner->GetInputEvent()->ClassName();
         fInputEvent = REST_Reflection::Assembly(tmp);
         fOutputEvent = fInputEvent;
-        fOutputFile = new TFile(threadFileName.c_str(), "recreate");
-        fOutputFile->SetCompressionLevel(fCompressionLevel);
+        OpenOutputFile(threadFileName);
         fOutputFile->cd();
 
         RESTDebug << "Creating Analysis Tree..." << RESTendl;
@@ -410,6 +439,7 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
             if (fEventTree->GetBranch(BranchName) == nullptr)  // avoid duplicated branch
             {
                 fEventTree->Branch(BranchName, fInputEvent->ClassName(), fInputEvent);
+                fSavedEvents.push_back(fInputEvent);
             }
         }
         // currently, external process analysis is not supported!
@@ -417,6 +447,29 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
     if (outputConfigToDel) delete outputConfig;
 }
 
+///////////////////////////////////////////////
+/// \brief Create the file where the processes save their output objects
+///
+/// If the host runner has `threadFilesInMemory` ON (the default), the file is
+/// a TMemFile which is merged to the main output file without touching the
+/// disk. Otherwise, or if the TMemFile cannot be created, a temporary file is
+/// created in REST_TMP_PATH.
+void TRestThread::OpenOutputFile(const string& fileName) {
+    fOutputFile = nullptr;
+    if (fileName != "/dev/null" && fHostRunner->UseThreadFilesInMemory()) {
+        fOutputFile = new TMemFile(fileName.c_str(), "recreate");
+        if (fOutputFile->IsZombie()) {
+            RESTWarning << "TRestThread: failed to create file in memory, using temporary file" << RESTendl;
+            delete fOutputFile;
+            fOutputFile = nullptr;
+        }
+    }
+    if (fOutputFile == nullptr) {
+        fOutputFile = new TFile(fileName.c_str(), "recreate");
+    }
+    fOutputFile->SetCompressionSettings(fCompressionSettings);
+}
+
 ///////////////////////////////////////////////
 /// \brief The main function of this class. Thread will run this function until
 /// the end.
@@ -424,7 +477,7 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
 /// It will start a loop, calling GetNextevtFunc(), ProcessEvent(), and
 /// FillThreadEventFunc() repeatedly. If the function GetNextEvent() returns
 /// false, the loop will break, meaning that we are at the end of the process.
-/// Before return it will set "isFinished" to true.
+/// Before return it will set "isFinished" to true, and notify the host runner.
 ///
 /// Note: The methods GetNextevtFunc() and FillThreadEventFunc() are all from
 /// TRestProcessRunner. The later two will call back the method FillEvent(),
@@ -434,21 +487,31 @@ void TRestThread::PrepareToProcess(bool* outputConfig) {
 /// prevents segmentation violation due to simultaneously read/write.
 void TRestThread::StartProcess() {
     isFinished = false;
+    fHostRunner->ThreadStarted(this);
 
-    while (fHostRunner->GetNextevtFunc(fInputEvent, fAnalysisTree) == 0) {
+    while (fHostRunner->GetNextevtFunc(this) == 0) {
         ProcessEvent();
         /*if (fOutputEvent != nullptr) */ fHostRunner->FillThreadEventFunc(this);
     }
 
     // fHostRunner->WriteThreadFileFunc(this);
+    fProfile.SetThread(fThreadId, fNProcessedEvents, fLockWaitTime / 1.e6);
     isFinished = true;
+    fHostRunner->ThreadFinished(this);
 }
 
 ///////////////////////////////////////////////
 /// \brief Create a thread with the method StartProcess().
 ///
-/// The thread will be detached afterwards.
+/// If a thread pool is set, StartProcess() runs as a task of its worker with
+/// the same id, which may be pinned to a cpu core. Otherwise a new thread is
+/// created and detached.
 void TRestThread::StartThread() {
+    isFinished = false;
+    if (fThreadPool != nullptr) {
+        fThreadPool->Submit([this] { StartProcess(); }, fThreadId);
+        return;
+    }
     t = thread(&TRestThread::StartProcess, this);
     t.detach();
     // t.join();
@@ -482,9 +545,25 @@ void TRestThread::AddProcess(TRestEventProcess* process) {
 /// here. It gives the input event to the first process in process chain, then
 /// it gives the process result to the next process, so on. Finally it gets a
 /// result and saves it in the local output event.
+///
+/// The wall and cpu time of each process is added to the profile of the
+/// thread, see TRestProcessProfile.
 void TRestThread::ProcessEvent() {
     TRestEvent* ProcessedEvent = fInputEvent;
     fProcessNullReturned = false;
+    fNProcessedEvents++;
+
+    // the end of a process is the start of the next one
+    auto wallStart = std::chrono::steady_clock::now();
+    Double_t cpuStart = TRestProcessProfile::GetThreadCPUTime();
+    auto profileProcess = [&](int j, bool rejected) {
+        auto wallEnd = std::chrono::steady_clock::now();
+        Double_t cpuEnd = TRestProcessProfile::GetThreadCPUTime();
+        fProfile.Fill(j, std::chrono::duration<double>(wallEnd - wallStart).count(), cpuEnd - cpuStart,
+                      rejected);
+        wallStart = wallEnd;
+        cpuStart = cpuEnd;
+    };
 
     if (fVerboseLevel >= TRestStringOutput::REST_Verbose_Level::REST_Debug) {
 #ifdef TIME_MEASUREMENT
@@ -498,6 +577,7 @@ void TRestThread::ProcessEvent() {
             high_resolution_clock::time_point t1 = high_resolution_clock::now();
 #endif
 
+            if (fProcessChain[j]->readsEventData()) LoadEventData(ProcessedEvent);
             fProcessChain[j]->BeginOfEventProcess(ProcessedEvent);
             ProcessedEvent = fProcessChain[j]->ProcessEvent(ProcessedEvent);
             if (fProcessChain[j]->ApplyCut()) ProcessedEvent = nullptr;
@@ -507,6 +587,7 @@ void TRestThread::ProcessEvent() {
             high_resolution_clock::time_point t2 = high_resolution_clock::now();
             processtime[j] = (int)duration_cast<microseconds>(t2 - t1).count();
 #endif
+            profileProcess(j, ProcessedEvent == nullptr);
 
             if (ProcessedEvent == nullptr) {
                 cout << "------- End of process " + (string)fProcessChain[j]->GetName() +
@@ -532,6 +613,9 @@ void TRestThread::ProcessEvent() {
         }
 #endif
 
+        if (ProcessedEvent != nullptr) {
+            for (auto event : fSavedEvents) LoadEventData(event);
+        }
         if (fHostRunner->UseTestRun()) {
             fOutputEvent = ProcessedEvent;
         } else {
@@ -547,16 +631,27 @@ void TRestThread::ProcessEvent() {
             " =======");
     } else {
         for (unsigned int j = 0; j < fProcessChain.size(); j++) {
-            fProcessChain[j]->BeginOfEventProcess(ProcessedEvent);
-            ProcessedEvent = fProcessChain[j]->ProcessEvent(ProcessedEvent);
-            if (fProcessChain[j]->ApplyCut()) ProcessedEvent = nullptr;
-            fProcessChain[j]->EndOfEventProcess();
+            if (fProcessChain[j]->readsEventData()) LoadEventData(ProcessedEvent);
+            if (fHostRunner->GetSerialStage(j) != nullptr) {
+                ProcessedEvent = ProcessSerialized(j, ProcessedEvent);
+            } else {
+                fProcessChain[j]->BeginOfEventProcess(ProcessedEvent);
+                ProcessedEvent = fProcessChain[j]->ProcessEvent(ProcessedEvent);
+                if (fProcessChain[j]->ApplyCut()) ProcessedEvent = nullptr;
+                fProcessChain[j]->EndOfEventProcess();
+            }
+            profileProcess(j, ProcessedEvent == nullptr);
             if (ProcessedEvent == nullptr) {
                 fProcessNullReturned = true;
+                SkipSerialStages(j + 1);
                 break;
             }
         }
 
+        // the events saved are complete, even if no process read them
+        if (ProcessedEvent != nullptr) {
+            for (auto event : fSavedEvents) LoadEventData(event);
+        }
         if (fHostRunner->UseTestRun()) {
             fOutputEvent = ProcessedEvent;
         } else {
@@ -567,6 +662,79 @@ void TRestThread::ProcessEvent() {
     }
 }
 
+///////////////////////////////////////////////
+/// \brief Check if the process **i** of the chain runs in a serialized stage
+/// owned by another thread. Such a local instance is only a placeholder, it is
+/// not initialized, run or ended.
+bool TRestThread::IsSerialReplica(int i) const {
+    TRestSerialStage* stage = fHostRunner->GetSerialStage(i);
+    return stage != nullptr && stage->GetProcess() != fProcessChain[i];
+}
+
+///////////////////////////////////////////////
+/// \brief Run the single thread only process **i** in its serialized stage.
+///
+/// The shared instance waits for the turn of the current event, and fills the
+/// analysis tree of this thread. Its output event is copied to a local event
+/// when it is not the input one, as the next event will overwrite it while the
+/// rest of the chain runs in parallel. Returns nullptr if the event is cut.
+///
+/// With **validate** the observables of the process are validated for this
+/// event, as in the test run. The shared instance is only changed inside the
+/// stage.
+TRestEvent* TRestThread::ProcessSerialized(int i, TRestEvent* input, bool validate) {
+    TRestSerialStage* stage = fHostRunner->GetSerialStage(i);
+    TRestEventProcess* p = stage->GetProcess();
+
+    stage->Enter(fSequence);
+    TRestAnalysisTree* tree = p->GetAnalysisTree();
+    p->SwitchAnalysisTree(fAnalysisTree);
+    if (validate) p->SetObservableValidation(true);
+
+    p->BeginOfEventProcess(input);
+    TRestEvent* output = p->ProcessEvent(input);
+    if (p->ApplyCut()) output = nullptr;
+    p->EndOfEventProcess();
+
+    if (output != nullptr && output != input) output = CopySerialOutput(i, output);
+
+    if (validate) p->SetObservableValidation(false);
+    p->SwitchAnalysisTree(tree);
+    stage->Leave(fSequence);
+    return output;
+}
+
+///////////////////////////////////////////////
+/// \brief Copy the output event of the serialized stage **i** to the local
+/// event of this thread, which keeps the same address during the run.
+///
+TRestEvent* TRestThread::CopySerialOutput(int i, TRestEvent* output) {
+    TRestEvent*& copy = fSerialOutputEvents[i];
+    if (copy == nullptr && IsSerialReplica(i)) copy = fProcessChain[i]->GetOutputEvent();
+    if (copy == nullptr) copy = REST_Reflection::Assembly(output->ClassName());
+    copy->Initialize();
+    output->CloneTo(copy);
+    return copy;
+}
+
+///////////////////////////////////////////////
+/// \brief Read the data of **event** from the input file, if it was left out by
+/// `lazyEventLoading`, see TRestRun::LoadEvent()
+///
+void TRestThread::LoadEventData(TRestEvent* event) {
+    if (event->GetLazyEntry() >= 0) fHostRunner->GetRunInfo()->LoadEvent(event);
+}
+
+///////////////////////////////////////////////
+/// \brief Let the serialized stages from process **i** on go on without the current event
+///
+void TRestThread::SkipSerialStages(int i) {
+    for (unsigned int j = i; j < fProcessChain.size(); j++) {
+        TRestSerialStage* stage = fHostRunner->GetSerialStage(j);
+        if (stage != nullptr) stage->Skip(fSequence);
+    }
+}
+
 ///////////////////////////////////////////////
 /// \brief Write and close the output file
 ///
@@ -581,6 +749,8 @@ void TRestThread::EndProcess() {
     Int_t nErrors = 0;
     Int_t nWarnings = 0;
     for (unsigned int i = 0; i < fProcessChain.size(); i++) {
+        // the instance of a serialized stage is ended by its owner thread
+        if (IsSerialReplica(i)) continue;
         // The processes must call object->Write in this method
         fProcessChain[i]->EndProcess();
         if (fProcessChain[i]->GetError()) nErrors++;
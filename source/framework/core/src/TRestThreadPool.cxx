@@ -0,0 +1,408 @@
+/*************************************************************************
+ * This file is part of the REST software framework.                     *
+ *                                                                       *
+ * Copyright (C) 2016 GIFNA/TREX (University of Zaragoza)                *
+ * For more information see http://gifna.unizar.es/trex                  *
+ *                                                                       *
+ * REST is free software: you can redistribute it and/or modify          *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * REST is distributed in the hope that it will be useful,               *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have a copy of the GNU General Public License along with   *
+ * REST in $REST_PATH/LICENSE.                                           *
+ * If not, see http://www.gnu.org/licenses/.                             *
+ * For the list of contributors see $REST_PATH/CREDITS.                  *
+ *************************************************************************/
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// TRestThreadPool keeps a fixed set of worker threads for TRestProcessRunner.
+/// Each TRestThread runs its process chain as a task of the pool, instead of
+/// detaching its own std::thread.
+///
+/// The workers can be pinned to cpu cores, which is set by the parameter
+/// `threadAffinity` of TRestProcessRunner:
+///
+/// * **none** (default): the workers are not pinned, the system decides.
+/// * **compact**: the workers fill the cores of one NUMA node (or socket)
+/// before going to the next one. Hyper-threads of the same core are used
+/// together.
+/// * **scatter**: the workers are spread in round-robin over the NUMA nodes,
+/// using one hyper-thread of each core first.
+/// * an explicit list of cpu ids, e.g. **0-15,32-47**. Worker i is pinned to
+/// the i-th cpu of the list.
+///
+/// Only the cpus allowed to the process (e.g. by taskset or a batch system) are
+/// used. The topology is read from /sys, so pinning is only available on Linux.
+/// On other systems the workers are just not pinned.
+///
+/// \code
+/// <TRestProcessRunner name="Processor" verboseLevel="info">
+///     <parameter name="threadNumber" value="64"/>
+///     <parameter name="threadAffinity" value="scatter"/>
+///     ...
+/// \endcode
+///
+///--------------------------------------------------------------------------
+///
+/// RESTsoft - Software for Rare Event Searches with TPCs
+///
+/// History of developments:
+///
+/// 2026-Oct: First implementation, replacing the detached threads of
+///           TRestThread
+///
+/// \class TRestThreadPool
+///
+/// <hr>
+//////////////////////////////////////////////////////////////////////////
+
+#include "TRestThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <tuple>
+
+#include "TRestStringHelper.h"
+#include "TRestStringOutput.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace {
+/// Read a single integer from a file in /sys. Returns -1 if it is not available
+Int_t ReadSysInteger(const string& fileName) {
+    ifstream file(fileName);
+    Int_t value = -1;
+    if (file.is_open()) file >> value;
+    return value;
+}
+
+/// Cpu location in the machine topology
+struct CpuLocation {
+    Int_t fCpu;
+    Int_t fNode;
+    Int_t fCore;
+    Int_t fSibling;  // index of the hyper-thread inside its core
+};
+
+/// Range shared by the caller and the helpers of ParallelFor()
+struct ParallelRange {
+    const function<void(Long64_t, Long64_t)>* fBody;
+    Long64_t fBegin;
+    Long64_t fEnd;
+    Long64_t fGrain;
+    Long64_t fNChunks;
+    atomic<Long64_t> fNextChunk{0};
+    atomic<Long64_t> fDoneChunks{0};
+    mutex fMutex;
+    condition_variable fCondition;
+
+    /// Run chunks until none is left. The body is never touched once all the chunks are taken.
+    void Run() {
+        Long64_t chunk;
+        while ((chunk = fNextChunk++) < fNChunks) {
+            Long64_t first = fBegin + chunk * fGrain;
+            (*fBody)(first, min(first + fGrain, fEnd));
+            if (++fDoneChunks == fNChunks) {
+                lock_guard<mutex> lock(fMutex);
+                fCondition.notify_all();
+            }
+        }
+    }
+};
+}  // namespace
+
+///////////////////////////////////////////////
+/// \brief Create the pool with **nWorkers** threads, pinned according to **affinity**
+///
+TRestThreadPool::TRestThreadPool(Int_t nWorkers, string affinity) {
+    fNBusy = 0;
+    fStop = false;
+
+    vector<Int_t> cpus = GetCpuOrder(affinity);
+    if (!cpus.empty() && nWorkers > (Int_t)cpus.size()) {
+        RESTWarning << "TRestThreadPool: " << nWorkers << " threads requested for " << cpus.size()
+                    << " cpus, some cpus will be shared" << RESTendl;
+    }
+
+    fLocalTasks.resize(nWorkers);
+    fWorkerCpus.resize(nWorkers, -1);
+    for (int i = 0; i < nWorkers; i++) {
+        if (!cpus.empty()) fWorkerCpus[i] = cpus[i % cpus.size()];
+    }
+    for (int i = 0; i < nWorkers; i++) {
+        fWorkers.push_back(thread(&TRestThreadPool::WorkerLoop, this, i));
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Stop the workers once all the submitted tasks are done
+///
+TRestThreadPool::~TRestThreadPool() {
+    {
+        lock_guard<mutex> lock(fMutex);
+        fStop = true;
+    }
+    fTaskCondition.notify_all();
+    for (auto& w : fWorkers) {
+        if (w.joinable()) w.join();
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Add a task to the pool.
+///
+/// If **worker** is given, the task will run on that worker, e.g. to keep a
+/// TRestThread on the same core (and NUMA node) as its memory.
+void TRestThreadPool::Submit(function<void()> task, Int_t worker) {
+    {
+        lock_guard<mutex> lock(fMutex);
+        if (worker >= 0 && worker < (Int_t)fLocalTasks.size()) {
+            fLocalTasks[worker].push_back(move(task));
+        } else {
+            fTasks.push_back(move(task));
+        }
+    }
+    fTaskCondition.notify_all();
+}
+
+///////////////////////////////////////////////
+/// \brief Wait until all the submitted tasks are done
+///
+void TRestThreadPool::Wait() {
+    unique_lock<mutex> lock(fMutex);
+    fIdleCondition.wait(lock, [&] {
+        if (fNBusy > 0 || !fTasks.empty()) return false;
+        for (auto& q : fLocalTasks) {
+            if (!q.empty()) return false;
+        }
+        return true;
+    });
+}
+
+///////////////////////////////////////////////
+/// \brief Split the range [**begin**, **end**) in chunks of **grain** entries
+/// and call **body**(first, last) on each of them, using the idle workers.
+///
+/// The calling thread takes chunks as well, and returns once all of them are
+/// done. So it is safe to call it from a task of the pool, even if no worker is
+/// idle: the range is then just processed by the caller. Helpers are only given
+/// to the workers idle at the time of the call. During a run, the workers are
+/// busy with the process chains, so nothing is queued. If **grain** is not
+/// given, the range is split in about four chunks per worker.
+void TRestThreadPool::ParallelFor(Long64_t begin, Long64_t end,
+                                  const function<void(Long64_t, Long64_t)>& body, Long64_t grain) {
+    if (end <= begin) return;
+    Int_t nWorkers = GetNWorkers();
+    if (grain <= 0) grain = max<Long64_t>(1, (end - begin) / (4 * max(nWorkers, 1)));
+    Long64_t nChunks = (end - begin + grain - 1) / grain;
+    if (nChunks <= 1 || nWorkers <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    auto range = make_shared<ParallelRange>();
+    range->fBody = &body;
+    range->fBegin = begin;
+    range->fEnd = end;
+    range->fGrain = grain;
+    range->fNChunks = nChunks;
+
+    // helpers starting after the range is finished just return. The tasks waiting
+    // in the queues will take the idle workers first
+    Long64_t nHelpers = 0;
+    {
+        lock_guard<mutex> lock(fMutex);
+        Long64_t nIdle = nWorkers - fNBusy - (Long64_t)fTasks.size();
+        for (auto& q : fLocalTasks) nIdle -= q.size();
+        nHelpers = min<Long64_t>(nChunks - 1, nIdle);
+        for (Long64_t i = 0; i < nHelpers; i++) {
+            fTasks.push_back([range] { range->Run(); });
+        }
+    }
+    if (nHelpers > 0) fTaskCondition.notify_all();
+
+    range->Run();
+    unique_lock<mutex> lock(range->fMutex);
+    range->fCondition.wait(lock, [&] { return range->fDoneChunks.load() == nChunks; });
+}
+
+bool TRestThreadPool::HasTask(Int_t id) const { return !fLocalTasks[id].empty() || !fTasks.empty(); }
+
+void TRestThreadPool::WorkerLoop(Int_t id) {
+    if (fWorkerCpus[id] >= 0) PinCurrentThread(fWorkerCpus[id]);
+
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(fMutex);
+            fTaskCondition.wait(lock, [&] { return fStop || HasTask(id); });
+            if (!HasTask(id)) return;  // stopped and nothing left to do
+            if (!fLocalTasks[id].empty()) {
+                task = move(fLocalTasks[id].front());
+                fLocalTasks[id].pop_front();
+            } else {
+                task = move(fTasks.front());
+                fTasks.pop_front();
+            }
+            fNBusy++;
+        }
+
+        task();
+
+        {
+            lock_guard<mutex> lock(fMutex);
+            fNBusy--;
+        }
+        fIdleCondition.notify_all();
+    }
+}
+
+///////////////////////////////////////////////
+/// \brief Pin the calling thread to the given cpu. Returns false if it is not possible.
+///
+bool TRestThreadPool::PinCurrentThread(Int_t cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) != 0) {
+        RESTWarning << "TRestThreadPool: failed to pin thread to cpu " << cpu << RESTendl;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+///////////////////////////////////////////////
+/// \brief Parse a cpu list in the format of /sys and taskset, e.g. "0-3,8,10-11"
+///
+vector<Int_t> TRestThreadPool::ParseCpuList(string list) {
+    vector<Int_t> result;
+    for (auto& item : Split(list, ",")) {
+        auto range = Split(item, "-");
+        if (range.size() == 1) {
+            result.push_back(StringToInteger(range[0]));
+        } else if (range.size() == 2) {
+            for (int i = StringToInteger(range[0]); i <= StringToInteger(range[1]); i++) {
+                result.push_back(i);
+            }
+        }
+    }
+    return result;
+}
+
+///////////////////////////////////////////////
+/// \brief Get the ids of the cpus on which this process is allowed to run
+///
+vector<Int_t> TRestThreadPool::GetAvailableCpus() {
+    vector<Int_t> result;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &set)) result.push_back(i);
+        }
+        return result;
+    }
+#endif
+    for (unsigned int i = 0; i < thread::hardware_concurrency(); i++) {
+        result.push_back(i);
+    }
+    return result;
+}
+
+///////////////////////////////////////////////
+/// \brief Get the list of cpus to which the workers are pinned in order, for
+/// the given affinity policy. An empty list means no pinning.
+///
+vector<Int_t> TRestThreadPool::GetCpuOrder(string affinity) {
+    affinity = ToLower(affinity);
+    if (affinity == "" || affinity == "none" || affinity == "off") {
+        return {};
+    }
+#ifndef __linux__
+    RESTWarning << "TRestThreadPool: thread affinity is only supported on linux, ignored" << RESTendl;
+    return {};
+#endif
+
+    vector<Int_t> available = GetAvailableCpus();
+
+    if (affinity != "compact" && affinity != "scatter") {
+        vector<Int_t> result;
+        for (auto cpu : ParseCpuList(affinity)) {
+            if (find(available.begin(), available.end(), cpu) != available.end()) {
+                result.push_back(cpu);
+            } else {
+                RESTWarning << "TRestThreadPool: cpu " << cpu << " is not available, skipped" << RESTendl;
+            }
+        }
+        if (result.empty()) {
+            RESTWarning << "TRestThreadPool: invalid threadAffinity \"" << affinity
+                        << "\", threads will not be pinned" << RESTendl;
+        }
+        return result;
+    }
+
+    // read the topology of the available cpus
+    map<Int_t, Int_t> cpuNode;
+    for (int node = 0;; node++) {
+        ifstream file("/sys/devices/system/node/node" + ToString(node) + "/cpulist");
+        if (!file.is_open()) break;
+        string list;
+        file >> list;
+        for (auto cpu : ParseCpuList(list)) cpuNode[cpu] = node;
+    }
+
+    vector<CpuLocation> locations;
+    map<pair<Int_t, Int_t>, Int_t> siblings;
+    for (auto cpu : available) {
+        string dir = "/sys/devices/system/cpu/cpu" + ToString(cpu) + "/topology/";
+        Int_t package = ReadSysInteger(dir + "physical_package_id");
+        Int_t core = ReadSysInteger(dir + "core_id");
+        // without NUMA information, each socket is a node
+        Int_t node = cpuNode.count(cpu) ? cpuNode[cpu] : max(package, 0);
+        // core ids are only unique inside a package
+        Int_t coreKey = max(package, 0) * 100000 + (core >= 0 ? core : cpu);
+        Int_t sibling = siblings[{node, coreKey}]++;
+        locations.push_back({cpu, node, coreKey, sibling});
+    }
+
+    vector<Int_t> result;
+    if (affinity == "compact") {
+        sort(locations.begin(), locations.end(), [](const CpuLocation& a, const CpuLocation& b) {
+            return tie(a.fNode, a.fCore, a.fSibling) < tie(b.fNode, b.fCore, b.fSibling);
+        });
+        for (auto& l : locations) result.push_back(l.fCpu);
+    } else {
+        // one hyper-thread of each core first, then round-robin over the nodes
+        sort(locations.begin(), locations.end(), [](const CpuLocation& a, const CpuLocation& b) {
+            return tie(a.fSibling, a.fNode, a.fCore) < tie(b.fSibling, b.fNode, b.fCore);
+        });
+        map<Int_t, vector<Int_t>> nodeCpus;
+        for (auto& l : locations) nodeCpus[l.fNode].push_back(l.fCpu);
+        for (size_t i = 0; result.size() < locations.size(); i++) {
+            for (auto& n : nodeCpus) {
+                if (i < n.second.size()) result.push_back(n.second[i]);
+            }
+        }
+    }
+    return result;
+}
@@ -1,9 +1,22 @@
 
+#include <TClass.h>
+#include <TFile.h>
+#include <TInterpreter.h>
+#include <TRestAnalysisTree.h>
+#include <TRestBoundedQueue.h>
+#include <TRestManager.h>
 #include <TRestMetadata.h>
+#include <TRestProcessRunner.h>
 #include <TRestRun.h>
+#include <TRestThreadPool.h>
+#include <TTree.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <fstream>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -12,6 +25,136 @@ using namespace std;
 const auto filesPath = fs::path(__FILE__).parent_path().parent_path() / "files";
 const auto basicRunRml = filesPath / "TRestRunBasic.rml";
 const auto basicMetadataRml = filesPath / "TRestMetadataTest.rml";
+const auto processRunnerRml = filesPath / "TRestProcessRunnerTest.rml";
+const auto eventRateAnalysisRml = filesPath / "TRestEventRateAnalysisTest.rml";
+const auto outputPath = fs::temp_directory_path() / "restFrameworkCoreTest";
+
+// The framework has no concrete event class, the processing tests use this one
+void DeclareTestEvent() {
+    static bool declared = false;
+    if (declared) return;
+    const auto frameworkPath = fs::path(__FILE__).parent_path().parent_path().parent_path();
+    gInterpreter->AddIncludePath((frameworkPath / "core" / "inc").c_str());
+    gInterpreter->AddIncludePath((frameworkPath / "tools" / "inc").c_str());
+    gInterpreter->Declare(R"(
+        #include "TRestEvent.h"
+        class TRestTestEvent : public TRestEvent {
+           protected:
+            Bool_t FastCopyTo(TRestEvent* target) override {
+                CopyEventInfo(target);
+                ((TRestTestEvent*)target)->fValues = fValues;
+                fFastCopies++;
+                return true;
+            }
+            Bool_t FastSwap(TRestEvent* target) override {
+                SwapEventInfo(target);
+                fValues.swap(((TRestTestEvent*)target)->fValues);
+                fFastSwaps++;
+                return true;
+            }
+
+           public:
+            std::vector<Double_t> fValues;
+            static Int_t fFastCopies;  //!
+            static Int_t fFastSwaps;   //!
+
+            void Initialize() override {
+                TRestEvent::Initialize();
+                fValues.clear();
+            }
+            ClassDefOverride(TRestTestEvent, 1);
+        };
+        Int_t TRestTestEvent::fFastCopies = 0;
+        Int_t TRestTestEvent::fFastSwaps = 0;
+
+        // copied by the streamer
+        class TRestTestStreamedEvent : public TRestEvent {
+           public:
+            void Initialize() override { TRestEvent::Initialize(); }
+            ClassDefOverride(TRestTestStreamedEvent, 1);
+        };
+    )");
+    declared = true;
+}
+
+// Write a REST file with one event per ID, at ten times the ID in seconds, and the observable "value"
+// equal to twice the ID. With
+// **nFilesSplit** the metadata tells that the file continues in that number of split files.
+void WriteInputFile(const fs::path& fileName, const vector<int>& ids, int nFilesSplit = 0) {
+    DeclareTestEvent();
+    fs::create_directories(fileName.parent_path());
+
+    TRestRun run;
+    run.SetRunNumber(-1);
+    run.SetOutputFileName(fileName.string());
+    run.SetNFilesSplit(nFilesSplit);
+    run.FormOutputFile();
+    auto event = (TRestEvent*)TClass::GetClass("TRestTestEvent")->New();
+    run.AddEventBranch(event);
+    for (int id : ids) {
+        event->Initialize();
+        event->SetID(id);
+        event->SetRunOrigin(1);
+        event->SetTime(10.0 * id);
+        run.GetAnalysisTree()->SetEventInfo(event);
+        run.GetAnalysisTree()->SetObservableValue("value", 2.0 * id);
+        run.GetAnalysisTree()->Fill();
+        run.GetEventTree()->Fill();
+    }
+    run.UpdateOutputFile();
+    run.CloseFile();
+    delete event;
+}
+
+// Process **input** into **output** with TRestProcessRunnerTest.rml, or **rml**, keeping the events whose
+// ID is in **selectedIds**. The other parameters of the runner, e.g. threadNumber, are given in **args**.
+void RunProcessRunner(const fs::path& input, const fs::path& output, const vector<int>& selectedIds,
+                      const map<string, string>& args = {}, const fs::path& rml = processRunnerRml) {
+    DeclareTestEvent();
+    const string idsFile = output.string() + ".ids.txt";
+    ofstream ids(idsFile);
+    for (int id : selectedIds) ids << id << endl;
+    ids.close();
+
+    auto restArgs = REST_ARGS;
+    REST_ARGS = args;
+    REST_ARGS["inputFileName"] = input.string();
+    REST_ARGS["outputFileName"] = output.string();
+    REST_ARGS["fileWithIDs"] = idsFile;
+
+    TRestManager manager;
+    manager.LoadConfigFromFile(rml);
+    manager.GetProcessRunner()->RunProcess();
+
+    REST_ARGS = restArgs;
+}
+
+// The event IDs of the AnalysisTree of a REST file, following its split files
+vector<int> ReadEventIds(const fs::path& fileName) {
+    vector<int> ids;
+    string name = fileName.string();
+    for (int i = 1; fs::exists(name); i++) {
+        TFile file(name.c_str());
+        auto tree = (TTree*)file.Get("AnalysisTree");
+        if (tree != nullptr) {
+            Int_t id = -1;
+            tree->SetBranchAddress("eventID", &id);
+            for (Long64_t n = 0; n < tree->GetEntries(); n++) {
+                tree->GetEntry(n);
+                ids.push_back(id);
+            }
+            tree->ResetBranchAddresses();
+        }
+        name = fileName.string() + "." + to_string(i);
+    }
+    return ids;
+}
+
+vector<int> Range(int first, int n) {
+    vector<int> ids;
+    for (int i = 0; i < n; i++) ids.push_back(first + i);
+    return ids;
+}
 
 TEST(FrameworkCore, TestFiles) {
     cout << "FrameworkCore test files path: " << filesPath << endl;
@@ -58,3 +201,503 @@ TEST(FrameworkCore, TRestMetadata) {
     EXPECT_TRUE(restMetadataTest.GetParameter("p2") == "12.32");
     EXPECT_TRUE(restMetadataTest.GetParameter("p3") == "Aloha");
 }
+
+TEST(FrameworkCore, TRestMetadataLoadConfigFromMetadata) {
+    // a class loading a setting in LoadSectionMetadata(), without overriding CopySectionMetadata()
+    DeclareTestEvent();
+    gInterpreter->Declare(R"(
+        #include "TRestMetadata.h"
+        class TRestSectionTestMetadata : public TRestMetadata {
+           public:
+            std::string fFromSection;
+            void Initialize() override { fFromSection = ""; }
+            Int_t LoadSectionMetadata() override {
+                Int_t result = TRestMetadata::LoadSectionMetadata();
+                fFromSection = GetParameter("sectionValue", "none");
+                return result;
+            }
+            ClassDefOverride(TRestSectionTestMetadata, 1);
+        };
+    )");
+    fs::create_directories(outputPath);
+    const auto rml = outputPath / "TRestSectionTestMetadata.rml";
+    ofstream(rml) << "<TRestSectionTestMetadata name=\"prototype\" sectionValue=\"loaded\"/>" << endl;
+
+    TClass* c = TClass::GetClass("TRestSectionTestMetadata");
+    ASSERT_NE(c, nullptr);
+    auto prototype = (TRestMetadata*)c->New();
+    auto copy = (TRestMetadata*)c->New();
+    ASSERT_EQ(prototype->LoadConfigFromFile(rml.string()), 0);
+    EXPECT_EQ(prototype->GetDataMemberValue("fFromSection"), "loaded");
+
+    // the copy is loaded from the rml section, so it gets the setting as well
+    ASSERT_EQ(copy->LoadConfigFromMetadata(prototype), 0);
+    EXPECT_EQ(copy->GetDataMemberValue("fFromSection"), "loaded");
+    EXPECT_STREQ(copy->GetName(), "prototype");
+    delete prototype;
+    delete copy;
+}
+
+TEST(FrameworkCore, TRestBoundedQueue) {
+    const int nProducers = 4;
+    const int nConsumers = 4;
+    const int nItems = 20000;
+
+    // A small capacity makes both the producers and the consumers block often
+    TRestBoundedQueue<int> queue(4);
+    EXPECT_EQ(queue.Capacity(), 4u);
+
+    std::atomic<long long> poppedCount(0);
+    std::atomic<long long> poppedSum(0);
+
+    vector<thread> consumers;
+    for (int i = 0; i < nConsumers; i++) {
+        consumers.emplace_back([&] {
+            int item;
+            while (queue.Pop(item)) {
+                poppedCount++;
+                poppedSum += item;
+            }
+        });
+    }
+
+    vector<thread> producers;
+    for (int i = 0; i < nProducers; i++) {
+        producers.emplace_back([&, i] {
+            for (int n = 0; n < nItems; n++) {
+                EXPECT_TRUE(queue.Push(i * nItems + n));
+            }
+        });
+    }
+
+    for (auto& t : producers) t.join();
+    queue.Close();
+    for (auto& t : consumers) t.join();
+
+    const long long total = (long long)nProducers * nItems;
+    EXPECT_EQ(poppedCount.load(), total);
+    EXPECT_EQ(poppedSum.load(), total * (total - 1) / 2);
+    EXPECT_TRUE(queue.Empty());
+
+    int item = 0;
+    EXPECT_FALSE(queue.Push(1));
+    EXPECT_FALSE(queue.Pop(item));
+}
+
+TEST(FrameworkCore, TRestProcessRunnerOutputOrder) {
+    const auto input = outputPath / "orderInput.root";
+    const vector<int> inputIds = Range(100, 200);
+    WriteInputFile(input, inputIds);
+
+    // every third event is cut
+    vector<int> selected;
+    for (int id : inputIds) {
+        if (id % 3 != 0) selected.push_back(id);
+    }
+
+    // the reorder buffer writes the events in the input order whatever thread processed them
+    const vector<map<string, string>> configs = {
+        {{"threadNumber", "4"}},
+        {{"threadNumber", "4"}, {"dispatchChunkSize", "8"}},
+        {{"threadNumber", "4"}, {"usePipeline", "ON"}},
+        {{"threadNumber", "4"}, {"asyncOutput", "ON"}},
+        // the saved events are read by the threads while the next ones are taken
+        {{"threadNumber", "4"}, {"lazyEventLoading", "ON"}},
+        {{"threadNumber", "4"}, {"lazyEventLoading", "ON"}, {"usePipeline", "ON"}},
+    };
+    for (size_t i = 0; i < configs.size(); i++) {
+        const auto output = outputPath / ("orderOutput" + to_string(i) + ".root");
+        RunProcessRunner(input, output, selected, configs[i]);
+        EXPECT_EQ(ReadEventIds(output), selected) << "configuration " << i;
+
+        // the saved events match their entries of the analysis tree
+        TRestRun run(output.string());
+        vector<int> eventIds;
+        for (int entry = 0; entry < run.GetEntries(); entry++) {
+            run.GetEntry(entry);
+            eventIds.push_back(run.GetInputEvent()->GetID());
+        }
+        EXPECT_EQ(eventIds, selected) << "configuration " << i;
+    }
+}
+
+TEST(FrameworkCore, TRestProcessRunnerEventsToProcess) {
+    const auto input = outputPath / "eventsToProcessInput.root";
+    const vector<int> inputIds = Range(0, 100);
+    WriteInputFile(input, inputIds);
+
+    vector<int> selected;
+    for (int id : inputIds) {
+        if (id % 3 != 0) selected.push_back(id);
+    }
+    // eventsToProcess counts the entries read, not the events written, in every dispatch mode
+    vector<int> expected;
+    for (int id : selected) {
+        if (id < 40) expected.push_back(id);
+    }
+    const vector<map<string, string>> configs = {
+        {{"threadNumber", "4"}, {"eventsToProcess", "40"}},
+        {{"threadNumber", "4"}, {"eventsToProcess", "40"}, {"dispatchChunkSize", "8"}},
+        {{"threadNumber", "4"}, {"eventsToProcess", "40"}, {"usePipeline", "ON"}},
+    };
+    for (size_t i = 0; i < configs.size(); i++) {
+        const auto output = outputPath / ("eventsToProcessOutput" + to_string(i) + ".root");
+        RunProcessRunner(input, output, selected, configs[i]);
+        EXPECT_EQ(ReadEventIds(output), expected) << "configuration " << i;
+    }
+}
+
+TEST(FrameworkCore, TRestProcessRunnerShards) {
+    const auto input = outputPath / "shardInput.root";
+    const vector<int> inputIds = Range(0, 100);
+    WriteInputFile(input, inputIds);
+
+    const int nShards = 3;
+    auto shardFile = [&](const string& name, int i) {
+        return outputPath / (name + "_shard" + to_string(i) + "of" + to_string(nShards) + ".root");
+    };
+
+    // the shards are disjoint and cover the input, in order
+    vector<int> allIds;
+    for (int i = 0; i < nShards; i++) {
+        const string shard = to_string(i) + "/" + to_string(nShards);
+        RunProcessRunner(input, outputPath / "shardAll.root", inputIds,
+                         {{"shard", shard}, {"threadNumber", "2"}});
+        vector<int> ids = ReadEventIds(shardFile("shardAll", i));
+        EXPECT_FALSE(ids.empty());
+        allIds.insert(allIds.end(), ids.begin(), ids.end());
+    }
+    EXPECT_EQ(allIds, inputIds);
+
+    // with a cut, each shard still stops at its last entry, so the merged file has no duplicates
+    vector<int> selected;
+    for (int id : inputIds) {
+        if (id % 4 != 1) selected.push_back(id);
+    }
+    const vector<map<string, string>> configs = {
+        {{"threadNumber", "2"}},
+        {{"threadNumber", "2"}, {"dispatchChunkSize", "8"}},
+        {{"threadNumber", "2"}, {"usePipeline", "ON"}},
+    };
+    for (size_t c = 0; c < configs.size(); c++) {
+        const string name = "shardCut" + to_string(c);
+        vector<string> files;
+        for (int i = 0; i < nShards; i++) {
+            auto args = configs[c];
+            args["shard"] = to_string(i) + "/" + to_string(nShards);
+            RunProcessRunner(input, outputPath / (name + ".root"), selected, args);
+            files.push_back(shardFile(name, i).string());
+        }
+
+        const auto merged = outputPath / (name + "Merged.root");
+        TRestProcessRunner runner;
+        ASSERT_EQ(runner.MergeShards(files, merged.string()), 0);
+        EXPECT_EQ(ReadEventIds(merged), selected) << "configuration " << c;
+    }
+
+    // the split files of a shard are merged after its main file. Shard 1 processes the entries 33 to
+    // 65, it is resumed after its first 10 entries, which splits its output
+    const string name = "shardSplit";
+    vector<string> files;
+    for (int i = 0; i < nShards; i++) {
+        map<string, string> args = {{"shard", to_string(i) + "/" + to_string(nShards)},
+                                    {"threadNumber", "2"},
+                                    {"checkpointInterval", "10"}};
+        const auto output = outputPath / (name + ".root");
+        const auto shardOutput = shardFile(name, i);
+        fs::remove(shardOutput.string() + ".1");
+        RunProcessRunner(input, output, selected, args);
+        if (i == 1) {
+            const auto written =
+                count_if(selected.begin(), selected.end(), [](int id) { return id >= 33 && id < 43; });
+            ofstream checkpoint(shardOutput.string() + ".checkpoint");
+            checkpoint << "firstEntry 33" << endl;
+            checkpoint << "eventsToProcess 33" << endl;
+            checkpoint << "committedEntries 10" << endl;
+            checkpoint << "processedEvents " << written << endl;
+            checkpoint << "filesSplit 0" << endl;
+            checkpoint << "analysisTreeEntries " << written << endl;
+            checkpoint << "eventTreeEntries " << written << endl;
+            checkpoint.close();
+            args["resume"] = "ON";
+            RunProcessRunner(input, output, selected, args);
+            ASSERT_TRUE(fs::exists(shardOutput.string() + ".1"));
+        }
+        files.push_back(shardOutput.string());
+    }
+    const auto merged = outputPath / (name + "Merged.root");
+    TRestProcessRunner runner;
+    ASSERT_EQ(runner.MergeShards(files, merged.string()), 0);
+    EXPECT_EQ(ReadEventIds(merged), selected);
+}
+
+TEST(FrameworkCore, TRestProcessRunnerResume) {
+    const auto input = outputPath / "resumeInput.root";
+    const int nEntries = 120;
+    const vector<int> inputIds = Range(0, nEntries);
+    WriteInputFile(input, inputIds);
+
+    vector<int> selected;
+    for (int id : inputIds) {
+        if (id % 5 != 2) selected.push_back(id);
+    }
+
+    const auto complete = outputPath / "resumeComplete.root";
+    const auto resumed = outputPath / "resumeResumed.root";
+    for (const auto& output : {complete, resumed}) {
+        for (int i = 1; fs::exists(output.string() + "." + to_string(i)); i++) {
+            fs::remove(output.string() + "." + to_string(i));
+        }
+    }
+
+    map<string, string> args = {
+        {"threadNumber", "3"}, {"checkpointInterval", "10"}, {"eventsToProcess", to_string(nEntries)}};
+    RunProcessRunner(input, complete, selected, args);
+    EXPECT_EQ(ReadEventIds(complete), selected);
+    EXPECT_FALSE(fs::exists(complete.string() + ".checkpoint"));
+
+    // a job which died after the checkpoint at entry 40, having written some more entries
+    RunProcessRunner(input, resumed, selected, args);
+    const int committed = 40;
+    const auto written = count_if(selected.begin(), selected.end(), [&](int id) { return id < committed; });
+    ofstream checkpoint(resumed.string() + ".checkpoint");
+    checkpoint << "firstEntry 0" << endl;
+    checkpoint << "eventsToProcess " << nEntries << endl;
+    checkpoint << "committedEntries " << committed << endl;
+    checkpoint << "processedEvents " << written << endl;
+    checkpoint << "filesSplit 0" << endl;
+    checkpoint << "analysisTreeEntries " << written << endl;
+    checkpoint << "eventTreeEntries " << written << endl;
+    checkpoint.close();
+
+    args["resume"] = "ON";
+    RunProcessRunner(input, resumed, selected, args);
+    EXPECT_TRUE(fs::exists(resumed.string() + ".1"));
+    EXPECT_EQ(ReadEventIds(resumed), ReadEventIds(complete));
+    EXPECT_FALSE(fs::exists(resumed.string() + ".checkpoint"));
+}
+
+TEST(FrameworkCore, TRestRunGetEventWithID) {
+    // the IDs are not sorted in the input
+    vector<int> inputIds;
+    for (int i = 0; i < 60; i++) inputIds.push_back((i * 37) % 60);
+    const auto input = outputPath / "eventIdInput.root";
+    WriteInputFile(input, inputIds);
+
+    vector<int> selected;
+    for (int id : inputIds) {
+        if (id % 6 != 0) selected.push_back(id);
+    }
+    const auto output = outputPath / "eventIdOutput.root";
+    RunProcessRunner(input, output, selected, {{"threadNumber", "2"}});
+
+    TRestRun run(output.string());
+    ASSERT_NE(run.GetAnalysisTree(), nullptr);
+    EXPECT_TRUE(run.GetAnalysisTree()->HasEventIndex());
+    for (int id : selected) {
+        TRestEvent* event = run.GetEventWithID(id);
+        ASSERT_NE(event, nullptr) << "event " << id;
+        EXPECT_EQ(run.GetAnalysisTree()->GetEventID(), id);
+        EXPECT_EQ(event->GetID(), id);
+    }
+    // the events cut are not in the output
+    EXPECT_EQ(run.GetEventWithID(6), nullptr);
+    EXPECT_EQ(run.GetEventWithID(1000), nullptr);
+}
+
+TEST(FrameworkCore, TRestRunGetEventWithIDSplitFiles) {
+    // the event IDs of the split file are below the ones of the main file, so the chain has no global index
+    const auto input = outputPath / "eventIdSplit.root";
+    WriteInputFile(input, Range(10, 10), 1);
+    WriteInputFile(input.string() + ".1", Range(0, 10));
+
+    TRestRun run(input.string());
+    ASSERT_NE(run.GetAnalysisTree(), nullptr);
+    ASSERT_NE(run.GetAnalysisTree()->GetChain(), nullptr);
+    EXPECT_EQ(run.GetEntries(), 20);
+    for (int id = 0; id < 20; id++) {
+        ASSERT_NE(run.GetEventWithID(id), nullptr) << "event " << id;
+        EXPECT_EQ(run.GetAnalysisTree()->GetEventID(), id);
+        EXPECT_EQ(run.GetCurrentEntry(), id < 10 ? id + 10 : id - 10);
+    }
+    EXPECT_EQ(run.GetEventWithID(20), nullptr);
+}
+
+TEST(FrameworkCore, TRestRunGetEventEntriesWithConditions) {
+    const auto input = outputPath / "conditions.root";
+    vector<int> ids;
+    for (int i = 0; i < 500; i++) ids.push_back((i * 7) % 500);
+    WriteInputFile(input, ids, 1);
+    WriteInputFile(input.string() + ".1", Range(1000, 300));
+
+    TRestRun run(input.string());
+    ASSERT_EQ(run.GetEntries(), 800);
+
+    const vector<string> cuts = {"value>=600",           "value<100&&eventID>10", "value==40",
+                                 "eventID<=7",           "value>2000",            "eventID=1200",
+                                 "value>100&&value<=900"};
+    for (const auto& cut : cuts) {
+        for (int startingIndex : {0, 333}) {
+            for (int maxNumber : {-1, 5}) {
+                // the conditions evaluated entry by entry
+                vector<int> expected;
+                for (int i = 0; i < run.GetEntries(); i++) {
+                    int entry = (i + startingIndex) % run.GetEntries();
+                    run.GetEntry(entry);
+                    const int id = run.GetAnalysisTree()->GetEventID();
+                    const double value = run.GetAnalysisTree()->GetObservableValue<double>("value");
+                    bool pass = true;
+                    for (const auto& condition : Split(cut, "&&")) {
+                        const double threshold = stod(condition.substr(condition.find_last_of("=<>") + 1));
+                        const double x = condition.rfind("eventID", 0) == 0 ? id : value;
+                        if (condition.find(">=") != string::npos) {
+                            pass &= x >= threshold;
+                        } else if (condition.find("<=") != string::npos) {
+                            pass &= x <= threshold;
+                        } else if (condition.find('>') != string::npos) {
+                            pass &= x > threshold;
+                        } else if (condition.find('<') != string::npos) {
+                            pass &= x < threshold;
+                        } else {
+                            pass &= x == threshold;
+                        }
+                    }
+                    if (pass && (maxNumber < 0 || (int)expected.size() < maxNumber)) {
+                        expected.push_back(entry);
+                    }
+                }
+                EXPECT_EQ(run.GetEventEntriesWithConditions(cut, startingIndex, maxNumber), expected)
+                    << cut << " from " << startingIndex << " up to " << maxNumber;
+            }
+        }
+    }
+    // an unknown observable selects nothing
+    EXPECT_TRUE(run.GetEventEntriesWithConditions("unknown>0").empty());
+}
+
+TEST(FrameworkCore, TRestAnalysisTreeRequiredObservables) {
+    TRestAnalysisTree tree("requiredObservablesTree", "requiredObservablesTree");
+    tree.SetObservableFilter({}, {"dropped_*"});
+
+    EXPECT_TRUE(tree.IsObservableActive("kept_value"));
+    EXPECT_FALSE(tree.IsObservableActive("dropped_value"));
+
+    // read by a process after it was skipped
+    EXPECT_TRUE(tree.AddRequiredObservable("dropped_value"));
+    EXPECT_TRUE(tree.IsObservableActive("dropped_value"));
+    EXPECT_FALSE(tree.AddRequiredObservable("dropped_value"));
+
+    // required before the filter is asked
+    EXPECT_FALSE(tree.AddRequiredObservable("dropped_other"));
+    EXPECT_TRUE(tree.IsObservableActive("dropped_other"));
+    EXPECT_FALSE(tree.IsObservableActive("dropped_third"));
+}
+
+TEST(FrameworkCore, TRestEventRateAnalysisProcessSerialStage) {
+    const auto input = outputPath / "rateInput.root";
+    const vector<int> inputIds = Range(0, 100);
+    WriteInputFile(input, inputIds);
+
+    vector<int> selected;
+    for (int id : inputIds) {
+        if (id % 3 != 0) selected.push_back(id);
+    }
+
+    // the single thread only process runs in a serialized stage, it keeps its order dependent observables
+    const auto output = outputPath / "rateOutput.root";
+    RunProcessRunner(input, output, selected, {{"threadNumber", "4"}}, eventRateAnalysisRml);
+    ASSERT_EQ(ReadEventIds(output), selected);
+
+    TFile file(output.c_str());
+    auto tree = (TTree*)file.Get("AnalysisTree");
+    ASSERT_NE(tree, nullptr);
+    ASSERT_NE(tree->GetBranch("rate_EventTimeDelay"), nullptr);
+    ASSERT_NE(tree->GetBranch("rate_MeanRate_InHz"), nullptr);
+    Double_t delay = 0;
+    tree->SetBranchAddress("rate_EventTimeDelay", &delay);
+    // the first delay may follow the events of the test run
+    for (Long64_t n = 1; n < tree->GetEntries(); n++) {
+        tree->GetEntry(n);
+        EXPECT_DOUBLE_EQ(delay, 10.0 * (selected[n] - selected[n - 1])) << "entry " << n;
+    }
+    tree->ResetBranchAddresses();
+}
+
+TEST(FrameworkCore, TRestEventCloneAndMove) {
+    DeclareTestEvent();
+    for (const string className : {"TRestTestEvent", "TRestTestStreamedEvent"}) {
+        auto source = (TRestEvent*)TClass::GetClass(className.c_str())->New();
+        auto target = (TRestEvent*)TClass::GetClass(className.c_str())->New();
+        const Long_t fastCopies = gInterpreter->Calc("TRestTestEvent::fFastCopies");
+        const Long_t fastSwaps = gInterpreter->Calc("TRestTestEvent::fFastSwaps");
+        const bool fast = className == "TRestTestEvent";
+        // the data of TRestTestEvent is only known to the interpreter
+        auto values = [](TRestEvent* event) {
+            return "((TRestTestEvent*)" + to_string((Long_t)event) + ")->fValues";
+        };
+
+        source->Initialize();
+        source->SetID(7);
+        source->SetSubID(3);
+        source->SetSubEventTag("tag");
+        source->SetRunOrigin(12);
+        source->SetSubRunOrigin(2);
+        source->SetTime(70.0, 5.0);
+        source->SetLazyEntry(42);
+        if (fast) gInterpreter->ProcessLine((values(source) + " = {1, 2};").c_str());
+
+        auto checkEvent = [&](TRestEvent* event) {
+            EXPECT_EQ(event->GetID(), 7) << className;
+            EXPECT_EQ(event->GetSubID(), 3) << className;
+            EXPECT_EQ(string(event->GetSubEventTag().Data()), "tag") << className;
+            EXPECT_EQ(event->GetRunOrigin(), 12) << className;
+            EXPECT_EQ(event->GetSubRunOrigin(), 2) << className;
+            EXPECT_EQ(event->GetTimeStamp().GetSec(), 70) << className;
+            EXPECT_EQ(event->GetTimeStamp().GetNanoSec(), 5) << className;
+            EXPECT_EQ(event->GetLazyEntry(), 42) << className;
+            if (fast) EXPECT_EQ(gInterpreter->Calc((values(event) + ".size()").c_str()), 2);
+        };
+
+        target->Initialize();
+        source->CloneTo(target);
+        checkEvent(target);
+        checkEvent(source);
+
+        target->Initialize();
+        source->MoveTo(target);
+        checkEvent(target);
+
+        EXPECT_EQ(gInterpreter->Calc("TRestTestEvent::fFastCopies") - fastCopies, fast ? 1 : 0) << className;
+        EXPECT_EQ(gInterpreter->Calc("TRestTestEvent::fFastSwaps") - fastSwaps, fast ? 1 : 0) << className;
+        delete source;
+        delete target;
+    }
+}
+
+TEST(FrameworkCore, TRestThreadPoolParallelFor) {
+    const int nWorkers = 4;
+    TRestThreadPool pool(nWorkers);
+
+    // from outside the pool, the idle workers help
+    vector<int> values(10000, 0);
+    pool.ParallelFor(0, values.size(), [&](Long64_t first, Long64_t last) {
+        for (Long64_t n = first; n < last; n++) values[n] += n;
+    });
+    for (int n = 0; n < (int)values.size(); n++) ASSERT_EQ(values[n], n);
+
+    // from the tasks of all the workers, as the processes of a run do for each event. No helper can
+    // run, the callers do all the chunks
+    std::atomic<long long> sum(0);
+    const int nCalls = 2000;
+    for (int i = 0; i < nWorkers; i++) {
+        pool.Submit([&] {
+            for (int call = 0; call < nCalls; call++) {
+                pool.ParallelFor(0, 100, [&](Long64_t first, Long64_t last) {
+                    for (Long64_t n = first; n < last; n++) sum += n;
+                });
+            }
+        });
+    }
+    pool.Wait();
+    EXPECT_EQ(sum.load(), (long long)nWorkers * nCalls * 4950);
+}